@@ -0,0 +1,312 @@
+// Copyright 2024-2025 Aidan Sun and the ImGuiTextSelect contributors
+// SPDX-License-Identifier: MIT
+
+// Benchmarks for the TextSelect hot paths: hit-testing while dragging, selection drawing, copying, and word selection,
+// and for reading text through a memory-mapped file.
+// These run in a headless Dear ImGui context with the default font, so no window or graphics backend is needed.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <imgui.h>
+
+#include "textselect.hpp"
+#include "textselect_mmap.hpp"
+
+// Number of allocations made through operator new and Dear ImGui's allocator
+static std::size_t allocCount = 0;
+
+void* operator new(std::size_t size) {
+    allocCount++;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+static void* imguiAlloc(std::size_t size, void*) {
+    allocCount++;
+    return std::malloc(size);
+}
+
+static void imguiFree(void* ptr, void*) {
+    std::free(ptr);
+}
+
+// Text used for a benchmark, lines are stored as strings and viewed by the TextSelect instance
+struct Corpus {
+    const char* name;
+    std::vector<std::string> storage;
+    std::vector<std::string_view> lines;
+};
+
+// Accumulated timing and allocation count of a benchmarked operation
+struct Measurement {
+    std::chrono::nanoseconds time{};
+    std::size_t allocs = 0;
+    std::size_t ops = 0;
+};
+
+// Runs a function as one operation of a measurement.
+template <class F>
+static void measure(Measurement& m, F&& f) {
+    std::size_t allocsBefore = allocCount;
+    auto start = std::chrono::steady_clock::now();
+    f();
+    m.time += std::chrono::steady_clock::now() - start;
+    m.allocs += allocCount - allocsBefore;
+}
+
+// Prints the results of a measurement.
+static void report(const Corpus& corpus, const char* name, const Measurement& m) {
+    double ops = static_cast<double>(m.ops == 0 ? 1 : m.ops);
+    std::printf("%-24s %-28s %14.0f ns/op %10.2f allocs/op\n", corpus.name, name,
+        static_cast<double>(m.time.count()) / ops, static_cast<double>(m.allocs) / ops);
+}
+
+// Creates a corpus of lines generated from a pattern.
+template <class F>
+static Corpus makeCorpus(const char* name, std::size_t numLines, F&& makeLine) {
+    Corpus corpus{ name, {}, {} };
+    corpus.storage.reserve(numLines);
+    for (std::size_t i = 0; i < numLines; i++) corpus.storage.push_back(makeLine(i));
+
+    corpus.lines.assign(corpus.storage.begin(), corpus.storage.end());
+    return corpus;
+}
+
+// Creates a line of words from a list, repeated to the given length in words.
+static std::string makeWords(std::size_t seed, std::size_t numWords, const std::vector<std::string_view>& words) {
+    std::string line;
+    for (std::size_t i = 0; i < numWords; i++) {
+        if (i > 0) line += ' ';
+        line += words[(seed * 31 + i * 7) % words.size()];
+    }
+    return line;
+}
+
+// Size of the window containing the text
+constexpr ImVec2 windowSize{ 800, 600 };
+
+// Runs one frame with a window containing the text, calling a function inside the window.
+// The text itself is not rendered, a dummy item takes up its space so the window can be scrolled.
+template <class F>
+static void runFrame(const Corpus& corpus, float scrollY, F&& f) {
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos({ 0, 0 });
+    ImGui::SetNextWindowSize(windowSize);
+    ImGui::SetNextWindowScroll({ 0, scrollY });
+    ImGui::Begin("Text", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove);
+
+    float contentHeight = static_cast<float>(corpus.lines.size()) * ImGui::GetTextLineHeightWithSpacing();
+    ImGui::Dummy({ windowSize.x, contentHeight - ImGui::GetStyle().ItemSpacing.y });
+    f();
+
+    ImGui::End();
+    ImGui::EndFrame();
+}
+
+// Moves the mouse and sets the left mouse button state.
+static void setMouse(float x, float y, bool down) {
+    ImGuiIO& io = ImGui::GetIO();
+    io.AddMousePosEvent(x, y);
+    io.AddMouseButtonEvent(ImGuiMouseButton_Left, down);
+}
+
+// Lets enough time pass for the next click to not count as a double click.
+static void resetClicks(const Corpus& corpus) {
+    ImGuiIO& io = ImGui::GetIO();
+    setMouse(-1, -1, false);
+    io.DeltaTime = 1.0f;
+    runFrame(corpus, 0, [] {});
+    io.DeltaTime = 1.0f / 60.0f;
+}
+
+// Measures hit-testing by dragging the mouse across the text with a TextSelect instance.
+static void runDrag(const Corpus& corpus, TextSelect& textSelect, const char* name) {
+    resetClicks(corpus);
+
+    // Start the drag, then move the mouse to a different position every frame
+    setMouse(10, 10, true);
+    runFrame(corpus, 0, [&] { textSelect.update(); });
+
+    Measurement m;
+    for (int i = 1; i <= 200; i++) {
+        float x = 10.0f + static_cast<float>((i * 37) % 700);
+        float y = 10.0f + static_cast<float>((i * 53) % 500);
+        setMouse(x, y, true);
+        runFrame(corpus, 0, [&] { measure(m, [&] { textSelect.update(); }); });
+        m.ops++;
+    }
+
+    setMouse(-1, -1, false);
+    runFrame(corpus, 0, [&] { textSelect.update(); });
+    report(corpus, name, m);
+}
+
+// Measures hit-testing by dragging the mouse across the text.
+static void benchDrag(const Corpus& corpus, bool widthCache) {
+    TextSelect textSelect{ corpus.lines };
+    textSelect.setWidthCacheEnabled(widthCache);
+    runDrag(corpus, textSelect, widthCache ? "drag (width cache)" : "drag");
+}
+
+// Measures dragging with the width cache allocated from a pool, so its memory is reused when the cache is refilled.
+static void benchDragPool(const Corpus& corpus) {
+    std::pmr::unsynchronized_pool_resource pool;
+    TextSelect textSelect{ corpus.lines, &pool };
+    textSelect.setWidthCacheEnabled(true);
+    runDrag(corpus, textSelect, "drag (width cache, pool)");
+}
+
+// Measures drawing a selection of all text, scrolled to the middle of the text.
+static void benchDraw(const Corpus& corpus) {
+    TextSelect textSelect{ corpus.lines };
+    textSelect.selectAll();
+
+    resetClicks(corpus);
+    float scrollY = static_cast<float>(corpus.lines.size() / 2) * ImGui::GetTextLineHeightWithSpacing();
+
+    Measurement m;
+    for (int i = 0; i < 200; i++) {
+        runFrame(corpus, scrollY, [&] { measure(m, [&] { textSelect.update(); }); });
+        m.ops++;
+    }
+
+    report(corpus, "draw (select all)", m);
+}
+
+// Measures copying all text.
+static void benchCopy(const Corpus& corpus) {
+    TextSelect textSelect{ corpus.lines };
+    textSelect.selectAll();
+
+    Measurement m;
+    for (int i = 0; i < 5; i++) {
+        runFrame(corpus, 0, [&] { measure(m, [&] { textSelect.copy(); }); });
+        m.ops++;
+    }
+
+    report(corpus, "copy (select all)", m);
+}
+
+// Measures selecting words by double-clicking.
+static void benchWordSelect(const Corpus& corpus) {
+    TextSelect textSelect{ corpus.lines };
+
+    Measurement m;
+    for (int i = 0; i < 50; i++) {
+        resetClicks(corpus);
+
+        // Two clicks at the same position, the second one selects a word
+        float x = 10.0f + static_cast<float>((i * 37) % 700);
+        float y = 10.0f + static_cast<float>((i * 53) % 500);
+        for (bool down : { true, false, true, false }) {
+            setMouse(x, y, down);
+            runFrame(corpus, 0, [&] { measure(m, [&] { textSelect.update(); }); });
+        }
+        m.ops++;
+    }
+
+    report(corpus, "word select (double click)", m);
+}
+
+// Measures indexing a file with the text through MappedFileSource, then copying all of it through the mapping.
+static void benchMappedFile(const Corpus& corpus) {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "textselect_bench.txt";
+    {
+        std::ofstream file{ path, std::ios::binary };
+        for (std::string_view line : corpus.lines) file << line << '\n';
+    }
+
+    {
+        Measurement index;
+        MappedFileSource source{ path };
+        measure(index, [&] {
+            while (!source.isIndexComplete()) std::this_thread::yield();
+        });
+        index.ops = 1;
+
+        if (!source.isOpen() || source.numLines() != corpus.lines.size()) {
+            std::printf("%-24s %-28s failed\n", corpus.name, "mapped file");
+        } else {
+            report(corpus, "mapped file (index)", index);
+
+            TextSelect textSelect{ source };
+            textSelect.selectAll();
+
+            Measurement m;
+            for (int i = 0; i < 5; i++) {
+                runFrame(corpus, 0, [&] { measure(m, [&] { textSelect.copy(); }); });
+                m.ops++;
+            }
+
+            report(corpus, "mapped file (copy all)", m);
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+int main() {
+    ImGui::SetAllocatorFunctions(imguiAlloc, imguiFree);
+    ImGui::CreateContext();
+
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = { 1280, 720 };
+    io.DeltaTime = 1.0f / 60.0f;
+
+    // Build the font atlas with the default font
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    io.Fonts->AddFontDefault();
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    const std::vector<std::string_view> asciiWords{ "lorem", "ipsum", "dolor", "sit", "amet,", "consectetur",
+        "adipiscing", "elit.", "[INFO]", "0x7ffe3c2a", "request_id=42", "(main.cpp:128)" };
+    const std::vector<std::string_view> cjkWords{ "日本語", "テキスト", "中文字符", "한국어", "選択", "——", "【注意】",
+        "ascii", "Ë", "⑤", "┌──┐" };
+
+    std::vector<Corpus> corpora;
+    corpora.push_back(makeCorpus("1M short lines", 1'000'000, [&](std::size_t i) {
+        return makeWords(i, 6 + i % 6, asciiWords);
+    }));
+    corpora.push_back(makeCorpus("1k lines of 100k chars", 1'000, [&](std::size_t i) {
+        std::string line = makeWords(i, 12'000, asciiWords);
+        line.resize(100'000, '.');
+        return line;
+    }));
+    corpora.push_back(makeCorpus("100k CJK-heavy lines", 100'000, [&](std::size_t i) {
+        return makeWords(i, 20 + i % 20, cjkWords);
+    }));
+
+    for (const Corpus& corpus : corpora) {
+        benchDrag(corpus, false);
+        benchDrag(corpus, true);
+        benchDragPool(corpus);
+        benchDraw(corpus);
+        benchCopy(corpus);
+        benchWordSelect(corpus);
+        benchMappedFile(corpus);
+    }
+
+    ImGui::DestroyContext();
+}
@@ -65,9 +65,8 @@ int main() {
 
         ImGui::BeginChild("text", {}, 0, ImGuiWindowFlags_NoMove);
 
-        for (const auto& line : lines) ImGui::TextUnformatted(line.data());
-
-        textSelect.update();
+        // Draw the text and handle selection, only the visible lines are drawn
+        textSelect.render();
 
         if (ImGui::BeginPopupContextWindow()) {
             ImGui::BeginDisabled(!textSelect.hasSelection());
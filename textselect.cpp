@@ -5,10 +5,18 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
 #include <numeric>
-#include <string>
+#include <span>
 #include <string_view>
+#include <tuple>
+#include <utility>
 
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -16,159 +24,1434 @@
 
 #include "textselect.hpp"
 
-// Simple word boundary detection, accounts for Latin Unicode blocks only.
-static bool isBoundary(char32_t c) {
-    using Range = std::array<char32_t, 2>;
-    std::array ranges{
-        Range{ 0x20, 0x2F },
-        Range{ 0x3A, 0x40 },
-        Range{ 0x5B, 0x60 },
-        Range{ 0x7B, 0xBF }
-    };
+#ifdef TEXTSELECT_STATS
+#include <chrono>
+
+// Statistics of the instance being updated, so functions without access to the instance can count their work
+static thread_local TextSelect::Stats* currentStats = nullptr;
+
+// Sets the current statistics and adds the time until the end of the scope to a field
+class StatsScope {
+    TextSelect::Stats* previous;
+    double* time;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+public:
+    StatsScope(TextSelect::Stats& stats, double* time) : previous(currentStats), time(time) {
+        currentStats = &stats;
+    }
+
+    ~StatsScope() {
+        *time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        currentStats = previous;
+    }
+};
+
+#define TEXTSELECT_COUNT(field, n) \
+    do { \
+        if (currentStats) currentStats->field += (n); \
+    } while (false)
+#define TEXTSELECT_TIME(field) StatsScope statsScope{ stats, &stats.field }
+#else
+#define TEXTSELECT_COUNT(field, n) ((void)0)
+#define TEXTSELECT_TIME(field) ((void)0)
+#endif
+
+// Profiler zones are disabled unless defined in the configuration header
+#ifndef TEXTSELECT_ZONE
+#define TEXTSELECT_ZONE(name) ((void)0)
+#endif
+
+// SIMD kernels for scanning UTF-8 text, define TEXTSELECT_NO_SIMD to only use the scalar versions
+#ifndef TEXTSELECT_NO_SIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TEXTSELECT_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTSELECT_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define TEXTSELECT_NEON
+#endif
+#endif
+
+#if defined(TEXTSELECT_AVX2) || defined(TEXTSELECT_SSE2) || defined(TEXTSELECT_NEON)
+#define TEXTSELECT_SIMD
+#endif
+
+#if defined(TEXTSELECT_AVX2)
+// Number of bytes processed at once
+constexpr std::ptrdiff_t simdWidth = 32;
+
+// Gets a bit mask of the bytes in a block that are not UTF-8 continuation bytes.
+static std::uint32_t leadByteMask(const char* p) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-65))));
+}
 
-    return std::find_if(ranges.begin(), ranges.end(), [c](const Range& r) { return c >= r[0] && c <= r[1]; })
-        != ranges.end();
+// Gets a bit mask of the bytes in a block that are ASCII characters.
+static std::uint32_t asciiMask(const char* p) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
 }
 
+// Gets a bit mask of the bytes in a block that are printable ASCII characters.
+static std::uint32_t printableMask(const char* p) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1F)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7F), v));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(printable));
+}
+#elif defined(TEXTSELECT_SSE2)
+constexpr std::ptrdiff_t simdWidth = 16;
+
+static std::uint32_t leadByteMask(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(-65))));
+}
+
+static std::uint32_t asciiMask(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return ~static_cast<std::uint32_t>(_mm_movemask_epi8(v)) & 0xFFFF;
+}
+
+static std::uint32_t printableMask(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(printable));
+}
+#elif defined(TEXTSELECT_NEON)
+constexpr std::ptrdiff_t simdWidth = 16;
+
+// Gets a bit mask from a comparison result (each byte is either 0x00 or 0xFF).
+static std::uint32_t neonMovemask(uint8x16_t v) {
+    const uint8x16_t weights{ 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t masked = vandq_u8(v, weights);
+    return vaddv_u8(vget_low_u8(masked)) | (static_cast<std::uint32_t>(vaddv_u8(vget_high_u8(masked))) << 8);
+}
+
+static std::uint32_t leadByteMask(const char* p) {
+    int8x16_t v = vld1q_s8(reinterpret_cast<const std::int8_t*>(p));
+    return neonMovemask(vcgtq_s8(v, vdupq_n_s8(-65)));
+}
+
+static std::uint32_t asciiMask(const char* p) {
+    int8x16_t v = vld1q_s8(reinterpret_cast<const std::int8_t*>(p));
+    return neonMovemask(vcgeq_s8(v, vdupq_n_s8(0)));
+}
+
+static std::uint32_t printableMask(const char* p) {
+    int8x16_t v = vld1q_s8(reinterpret_cast<const std::int8_t*>(p));
+    return neonMovemask(vandq_u8(vcgtq_s8(v, vdupq_n_s8(0x1F)), vcltq_s8(v, vdupq_n_s8(0x7F))));
+}
+#endif
+
+#ifdef TEXTSELECT_SIMD
+// Bit mask with a bit set for each byte in a block
+constexpr std::uint32_t fullMask = simdWidth == 32 ? 0xFFFFFFFF : 0xFFFF;
+
+// Gets the length of the longest prefix of a string where a block mask function is true for each byte.
+template <std::uint32_t (*maskFn)(const char*)>
+static const char* scanBlocks(const char* begin, const char* end) {
+    for (; end - begin >= simdWidth; begin += simdWidth) {
+        std::uint32_t mask = maskFn(begin);
+        if (mask != fullMask) return begin + std::countr_one(mask);
+    }
+    return begin;
+}
+#endif
+
 // Gets the number of UTF-8 characters (not bytes) in a string.
+// Characters are counted by counting the bytes that are not continuation bytes.
 static std::size_t utf8Length(std::string_view s) {
-    return utf8::unchecked::distance(s.begin(), s.end());
+    const char* p = s.data();
+    const char* end = s.data() + s.size();
+    std::size_t length = 0;
+
+#ifdef TEXTSELECT_SIMD
+    for (; end - p >= simdWidth; p += simdWidth) length += static_cast<std::size_t>(std::popcount(leadByteMask(p)));
+#endif
+
+    for (; p != end; p++) length += (static_cast<unsigned char>(*p) & 0xC0) != 0x80;
+    return length;
+}
+
+// Gets the byte offset of a character in a string given its index, or the size of the string if it is out of range.
+static std::size_t utf8Offset(std::string_view s, std::size_t charIdx) {
+    const char* p = s.data();
+    const char* end = s.data() + s.size();
+
+    // Skip blocks that end before the character starts
+#ifdef TEXTSELECT_SIMD
+    for (; end - p >= simdWidth; p += simdWidth) {
+        auto count = static_cast<std::size_t>(std::popcount(leadByteMask(p)));
+        if (count > charIdx) break;
+        charIdx -= count;
+    }
+#endif
+
+    for (; p != end; p++) {
+        if ((static_cast<unsigned char>(*p) & 0xC0) == 0x80) continue;
+        if (charIdx-- == 0) break;
+    }
+
+    return static_cast<std::size_t>(p - s.data());
+}
+
+// Gets the end of the longest prefix of [begin, end) made of ASCII characters.
+static const char* skipAscii(const char* begin, const char* end) {
+#ifdef TEXTSELECT_SIMD
+    begin = scanBlocks<asciiMask>(begin, end);
+#endif
+    while (begin != end && static_cast<unsigned char>(*begin) < 0x80) begin++;
+    return begin;
+}
+
+// Gets the end of the longest prefix of [begin, end) made of printable ASCII characters (0x20 to 0x7E).
+static const char* skipPrintableAscii(const char* begin, const char* end) {
+#ifdef TEXTSELECT_SIMD
+    begin = scanBlocks<printableMask>(begin, end);
+#endif
+    while (begin != end && *begin >= 0x20 && *begin < 0x7F) begin++;
+    return begin;
+}
+
+// Range of characters of the same class
+struct ClassRange {
+    char32_t first;
+    char32_t last;
+    TextSelect::CharClass charClass;
+};
+
+using enum TextSelect::CharClass;
+
+// Classes of characters in the Basic Multilingual Plane, sorted and non-overlapping
+// Characters not in a range (letters, digits, marks, and the underscore) are word characters.
+constexpr std::array classRanges{
+    ClassRange{ 0x0000, 0x0020, Space }, // Control characters and space
+    ClassRange{ 0x0021, 0x002F, Punctuation },
+    ClassRange{ 0x003A, 0x0040, Punctuation },
+    ClassRange{ 0x005B, 0x005E, Punctuation },
+    ClassRange{ 0x0060, 0x0060, Punctuation },
+    ClassRange{ 0x007B, 0x007E, Punctuation },
+    ClassRange{ 0x007F, 0x00A0, Space }, // Control characters and no-break space
+    ClassRange{ 0x00A1, 0x00BF, Punctuation }, // Latin-1 punctuation and symbols
+    ClassRange{ 0x00D7, 0x00D7, Punctuation },
+    ClassRange{ 0x00F7, 0x00F7, Punctuation },
+    ClassRange{ 0x037E, 0x037E, Punctuation }, // Greek question mark
+    ClassRange{ 0x0387, 0x0387, Punctuation },
+    ClassRange{ 0x055A, 0x055F, Punctuation }, // Armenian punctuation
+    ClassRange{ 0x0589, 0x058A, Punctuation },
+    ClassRange{ 0x05BE, 0x05BE, Punctuation }, // Hebrew punctuation
+    ClassRange{ 0x05C0, 0x05C0, Punctuation },
+    ClassRange{ 0x05C3, 0x05C3, Punctuation },
+    ClassRange{ 0x05F3, 0x05F4, Punctuation },
+    ClassRange{ 0x060C, 0x060D, Punctuation }, // Arabic punctuation
+    ClassRange{ 0x061B, 0x061F, Punctuation },
+    ClassRange{ 0x066A, 0x066D, Punctuation },
+    ClassRange{ 0x06D4, 0x06D4, Punctuation },
+    ClassRange{ 0x0964, 0x0965, Punctuation }, // Devanagari danda
+    ClassRange{ 0x0E3F, 0x0E3F, Punctuation }, // Thai currency symbol
+    ClassRange{ 0x1680, 0x1680, Space }, // Ogham space mark
+    ClassRange{ 0x2000, 0x200A, Space }, // General punctuation spaces
+    ClassRange{ 0x2010, 0x2027, Punctuation },
+    ClassRange{ 0x2028, 0x2029, Space }, // Line and paragraph separators
+    ClassRange{ 0x202F, 0x202F, Space },
+    ClassRange{ 0x2030, 0x205E, Punctuation },
+    ClassRange{ 0x205F, 0x205F, Space },
+    ClassRange{ 0x20A0, 0x20CF, Punctuation }, // Currency symbols
+    ClassRange{ 0x2100, 0x2101, Punctuation }, // Letterlike symbols
+    ClassRange{ 0x2190, 0x2BFF, Punctuation }, // Arrows, math operators, technical symbols, box drawing, shapes
+    ClassRange{ 0x2E00, 0x2E7F, Punctuation }, // Supplemental punctuation
+    ClassRange{ 0x2E80, 0x2FDF, Ideograph }, // CJK radicals and Kangxi radicals
+    ClassRange{ 0x2FF0, 0x2FFF, Punctuation }, // Ideographic description characters
+    ClassRange{ 0x3000, 0x3000, Space }, // Ideographic space
+    ClassRange{ 0x3001, 0x3004, Punctuation }, // CJK symbols and punctuation
+    ClassRange{ 0x3005, 0x3007, Ideograph },
+    ClassRange{ 0x3008, 0x3020, Punctuation },
+    ClassRange{ 0x3021, 0x3029, Ideograph }, // Hangzhou numerals
+    ClassRange{ 0x3030, 0x3030, Punctuation },
+    ClassRange{ 0x3031, 0x3035, Ideograph }, // Kana repeat marks
+    ClassRange{ 0x303D, 0x303F, Punctuation },
+    ClassRange{ 0x3041, 0x30FA, Ideograph }, // Hiragana and katakana
+    ClassRange{ 0x30FB, 0x30FB, Punctuation }, // Katakana middle dot
+    ClassRange{ 0x30FC, 0x30FF, Ideograph },
+    ClassRange{ 0x3105, 0x312F, Ideograph }, // Bopomofo
+    ClassRange{ 0x31A0, 0x31BF, Ideograph },
+    ClassRange{ 0x31F0, 0x31FF, Ideograph }, // Katakana phonetic extensions
+    ClassRange{ 0x3400, 0x4DBF, Ideograph }, // CJK unified ideographs extension A
+    ClassRange{ 0x4DC0, 0x4DFF, Punctuation }, // Yijing hexagram symbols
+    ClassRange{ 0x4E00, 0x9FFF, Ideograph }, // CJK unified ideographs
+    ClassRange{ 0xA000, 0xA4CF, Ideograph }, // Yi syllables and radicals
+    ClassRange{ 0xD800, 0xDFFF, Space }, // Surrogates (invalid in UTF-8)
+    ClassRange{ 0xF900, 0xFAFF, Ideograph }, // CJK compatibility ideographs
+    ClassRange{ 0xFD3E, 0xFD3F, Punctuation }, // Ornate parentheses
+    ClassRange{ 0xFE10, 0xFE19, Punctuation }, // Vertical forms
+    ClassRange{ 0xFE30, 0xFE6F, Punctuation }, // CJK compatibility forms and small form variants
+    ClassRange{ 0xFEFF, 0xFEFF, Space }, // Byte order mark
+    ClassRange{ 0xFF01, 0xFF0F, Punctuation }, // Fullwidth forms
+    ClassRange{ 0xFF1A, 0xFF20, Punctuation },
+    ClassRange{ 0xFF3B, 0xFF3E, Punctuation },
+    ClassRange{ 0xFF40, 0xFF40, Punctuation },
+    ClassRange{ 0xFF5B, 0xFF65, Punctuation },
+    ClassRange{ 0xFF66, 0xFF9F, Ideograph }, // Halfwidth katakana
+    ClassRange{ 0xFFE0, 0xFFEE, Punctuation },
+    ClassRange{ 0xFFF9, 0xFFFD, Punctuation }, // Specials
+};
+
+// Size of the blocks in the character class lookup table
+constexpr std::size_t classBlockSize = 256;
+constexpr std::size_t numClassBlocks = 0x10000 / classBlockSize;
+
+// Checks if a block of characters has characters of different classes, i.e. a class range starts or ends inside it.
+constexpr bool isMixedBlock(std::size_t block) {
+    auto isInside = [block](char32_t c) { return c / classBlockSize == block && c % classBlockSize != 0; };
+    return std::any_of(classRanges.begin(), classRanges.end(),
+        [&isInside](const ClassRange& r) { return isInside(r.first) || isInside(r.last + 1); });
 }
 
-// Gets the display width of a substring.
-static float substringSizeX(std::string_view s, std::size_t start, std::size_t length = std::string_view::npos) {
-    // Convert char-based start and length into byte-based iterators
-    auto stringStart = s.begin();
-    utf8::unchecked::advance(stringStart, start);
+// Gets the number of blocks with characters of different classes.
+constexpr std::size_t countMixedBlocks() {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < numClassBlocks; i++) count += isMixedBlock(i);
+    return count;
+}
+
+// Two-level lookup table of character classes in the Basic Multilingual Plane
+// The first level maps each block of characters to a second level block containing their classes. Blocks where all
+// characters have the same class share one of the first four second level blocks (one for each class, in the order of
+// the CharClass values), and mixed blocks have their own.
+struct ClassTable {
+    std::array<std::uint8_t, numClassBlocks> blockIndex{};
+    std::array<std::array<TextSelect::CharClass, classBlockSize>, 4 + countMixedBlocks()> blocks{};
+};
+
+// Builds the character class lookup table from the class ranges.
+constexpr ClassTable makeClassTable() {
+    ClassTable table;
+    for (std::size_t i = 0; i < 4; i++) table.blocks[i].fill(static_cast<TextSelect::CharClass>(i));
+
+    // Ranges are sorted, so the ranges are walked along with the characters
+    std::size_t nextBlock = 4;
+    std::size_t rangeIdx = 0;
+    for (std::size_t block = 0; block < numClassBlocks; block++) {
+        auto first = static_cast<char32_t>(block * classBlockSize);
+        while (rangeIdx < classRanges.size() && classRanges[rangeIdx].last < first) rangeIdx++;
+
+        if (!isMixedBlock(block)) {
+            bool inRange = rangeIdx < classRanges.size() && classRanges[rangeIdx].first <= first;
+            table.blockIndex[block] = static_cast<std::uint8_t>(inRange ? classRanges[rangeIdx].charClass : Word);
+            continue;
+        }
+
+        table.blockIndex[block] = static_cast<std::uint8_t>(nextBlock);
+        std::size_t idx = rangeIdx;
+        for (std::size_t i = 0; i < classBlockSize; i++) {
+            auto c = static_cast<char32_t>(first + i);
+            while (idx < classRanges.size() && classRanges[idx].last < c) idx++;
 
-    auto stringEnd = stringStart;
-    if (length == std::string_view::npos) stringEnd = s.end();
-    else utf8::unchecked::advance(stringEnd, std::min(utf8Length(s), length));
+            bool inRange = idx < classRanges.size() && classRanges[idx].first <= c;
+            table.blocks[nextBlock][i] = inRange ? classRanges[idx].charClass : Word;
+        }
+        nextBlock++;
+    }
+
+    return table;
+}
 
-    // Dereferencing std::string_view::end() may be undefined behavior in some compilers,
-    // because of that, we need to get the pointer value manually if stringEnd == s.end().
-    const char* endPtr = stringEnd == s.end() ? s.data() + s.size() : &*stringEnd;
+constexpr ClassTable classTable = makeClassTable();
+static_assert(classTable.blocks.size() <= 256, "Block indices must fit in a byte");
+
+// Checks if a byte is a UTF-8 continuation byte (i.e. it is not the first byte of a character).
+static bool isContinuationByte(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+using Encoding = TextSelect::Encoding;
+
+// Decodes the character at an iterator and moves the iterator past it.
+// The helpers below are specialized for each encoding, ASCII characters are single bytes so they are never decoded.
+template <Encoding E>
+static char32_t nextChar(const char*& it) {
+    if constexpr (E == Encoding::ASCII) return static_cast<unsigned char>(*it++);
+    else return utf8::unchecked::next(it);
+}
+
+// Decodes the character before an iterator and moves the iterator to its start.
+template <Encoding E>
+static char32_t priorChar(const char*& it) {
+    if constexpr (E == Encoding::ASCII) return static_cast<unsigned char>(*--it);
+    else return utf8::unchecked::prior(it);
+}
+
+// Gets the byte offset of the start of the character containing a byte.
+template <Encoding E = Encoding::UTF8>
+static std::size_t getCharStart(std::string_view s, std::size_t byteIdx) {
+    if constexpr (E == Encoding::UTF8)
+        while (byteIdx > 0 && byteIdx < s.size() && isContinuationByte(s[byteIdx])) byteIdx--;
+
+    return byteIdx;
+}
+
+// Gets the start (inclusive) and end (exclusive) byte offsets of the word containing a character.
+// A "word" is either a sequence of non-boundary characters or a sequence of boundary characters. The string is walked
+// outwards from the character in both directions.
+template <Encoding E = Encoding::UTF8, class F>
+static std::array<std::size_t, 2> getWordBounds(std::string_view s, std::size_t byteIdx, F&& classify) {
+    if (s.empty()) return { 0, 0 };
+
+    const char* begin = s.data();
+    const char* end = s.data() + s.size();
+
+    // Positions past the end of the string are treated as the last character
+    const char* current = begin + getCharStart<E>(s, std::min(byteIdx, s.size() - 1));
+    const char* currentEnd = current;
+    TextSelect::CharClass currentClass = classify(nextChar<E>(currentEnd));
+
+    // Scan to left until a word boundary is reached
+    const char* wordStart = current;
+    for (const char* left = current; left != begin; wordStart = left) {
+        if (classify(priorChar<E>(left)) != currentClass) break;
+    }
+
+    // Scan to right until a word boundary is reached
+    const char* wordEnd = current;
+    for (const char* right = current; right != end; wordEnd = right) {
+        if (classify(nextChar<E>(right)) != currentClass) break;
+    }
+
+    return { static_cast<std::size_t>(wordStart - begin), static_cast<std::size_t>(wordEnd - begin) };
+}
+
+// Gets the display width of a substring given its start and end byte offsets.
+static float substringSizeX(std::string_view s, std::size_t start, std::size_t end = std::string_view::npos) {
+    end = std::min(end, s.size());
+    start = std::min(start, end);
 
     // Calculate text size between start and end
-    return ImGui::CalcTextSize(&*stringStart, endPtr).x;
+    TEXTSELECT_COUNT(calcTextSizeCalls, 1);
+    TEXTSELECT_COUNT(bytesMeasured, end - start);
+    return ImGui::CalcTextSize(s.data() + start, s.data() + end).x;
+}
+
+// Rounds a width up to a whole pixel like ImGui::CalcTextSize does, so positions from cached line metrics match
+// positions measured by Dear ImGui.
+static float roundTextWidth(float width) {
+    return std::trunc(width + 0.99999f);
 }
 
-// Gets the index of the character the mouse cursor is over.
-static std::size_t getCharIndex(std::string_view s, float cursorPosX, std::size_t start, std::size_t end) {
+// Gets the byte offset of the character the mouse cursor is over.
+template <Encoding E>
+static std::size_t getCharIndex(std::string_view s, float cursorPosX) {
     // Ignore cursor position when it is invalid
     if (cursorPosX < 0) return 0;
-
-    // Check for exit conditions
     if (s.empty()) return 0;
-    if (end < start) return utf8Length(s);
 
-    // Midpoint of given string range
-    std::size_t midIdx = std::midpoint(start, end);
+    // Perform a binary search over character start positions for the last character starting before the cursor
+    // The range [low, high] always contains the result, and low is always a character start.
+    std::size_t low = 0;
+    std::size_t high = s.size();
+    while (low < high) {
+        // Midpoint of the range, moved forward to a character start (high is always a character start)
+        std::size_t mid = std::midpoint(low, high + 1);
+        if constexpr (E == Encoding::UTF8)
+            while (mid < high && isContinuationByte(s[mid])) mid++;
+
+        if (substringSizeX(s, 0, mid) <= cursorPosX) low = mid;
+        else high = getCharStart<E>(s, mid - 1);
+    }
 
-    // Display width of the entire string up to the midpoint, gives the x-position where the (midIdx + 1)th char starts
-    float widthToMid = substringSizeX(s, 0, midIdx + 1);
+    return low;
+}
 
-    // Same as above but exclusive, gives the x-position where the (midIdx)th char starts
-    float widthToMidEx = substringSizeX(s, 0, midIdx);
+// Gets the display width of a single character, consistent with the measurement done by ImFont::CalcTextSizeA.
+static float getCharWidth(ImFont* font, float scale, char32_t c) {
+    // Newlines and carriage returns do not take up horizontal space
+    if (c == '\n' || c == '\r') return 0.0f;
+    if (c > IM_UNICODE_CODEPOINT_MAX) c = IM_UNICODE_CODEPOINT_INVALID;
 
-    // Perform a recursive binary search to find the correct index
-    // If the mouse position is between the (midIdx)th and (midIdx + 1)th character positions, the search ends
-    if (cursorPosX < widthToMidEx) return getCharIndex(s, cursorPosX, start, midIdx - 1);
-    else if (cursorPosX > widthToMid) return getCharIndex(s, cursorPosX, midIdx + 1, end);
-    else return midIdx;
+    return font->GetCharAdvance(static_cast<ImWchar>(c)) * scale;
 }
 
-// Wrapper for getCharIndex providing the initial bounds.
-static std::size_t getCharIndex(std::string_view s, float cursorPosX) {
-    return getCharIndex(s, cursorPosX, 0, utf8Length(s));
+// Gets the width of the characters in a font if they are all the same (i.e. it is a monospace font).
+// Only printable ASCII characters are checked, others are checked as they are measured. Returns 0 for other fonts.
+static float getMonospaceAdvance(ImFont* font, float scale, bool force) {
+    float advance = font->GetCharAdvance(' ');
+    if (!force) {
+        for (ImWchar c = '!'; c <= '~'; c++)
+            if (font->GetCharAdvance(c) != advance) return 0.0f;
+    }
+
+    return advance * scale;
 }
 
-// Gets the scroll delta for the given cursor position and window bounds.
-static float getScrollDelta(float v, float min, float max) {
-    const float deltaScale = 10.0f * ImGui::GetIO().DeltaTime;
-    const float maxDelta = 100.0f;
+// Maximum number of lines kept in the width cache before it is cleared.
+static constexpr std::size_t maxCachedLines = 4096;
+
+// Maximum number of lines fetched from the line source at once when processing large ranges.
+static constexpr std::size_t lineFetchSize = 256;
+
+// Number of lines in each chunk of work claimed by a precomputation worker.
+static constexpr std::size_t precomputeChunkSize = 4096;
+
+// Minimum number of lines left to be indexed for starting a precomputation.
+static constexpr std::size_t minPrecomputeLines = 4 * precomputeChunkSize;
+
+// Maximum number of lines measured by a precomputation, the next one is started once it is done.
+// This bounds the line views copied from vector sources when a precomputation starts.
+static constexpr std::size_t maxPrecomputeLines = 64 * precomputeChunkSize;
+
+// Finds the first occurrence of a pattern in a string at or after a byte offset, or npos if there is none.
+// Candidates are located with memchr (vectorized in common C libraries) on the pattern's first byte, then the rest of
+// the pattern is compared.
+static std::size_t findSubstring(std::string_view s, std::string_view pattern, std::size_t start) {
+    if (pattern.empty() || pattern.size() > s.size()) return std::string_view::npos;
 
-    if (v < min) return std::max(-(min - v), -maxDelta) * deltaScale;
-    else if (v > max) return std::min(v - max, maxDelta) * deltaScale;
+    const char* p = s.data() + start;
+    const char* last = s.data() + (s.size() - pattern.size()); // Last position where the pattern can start
+    while (p <= last) {
+        auto candidate = static_cast<const char*>(std::memchr(p, pattern[0], static_cast<std::size_t>(last - p) + 1));
+        if (candidate == nullptr) break;
+
+        if (std::memcmp(candidate + 1, pattern.data() + 1, pattern.size() - 1) == 0)
+            return static_cast<std::size_t>(candidate - s.data());
+        p = candidate + 1;
+    }
+
+    return std::string_view::npos;
+}
+
+// Gets the signed distance of a cursor position outside of the given window bounds (0 if it is inside).
+static float getOutsideDistance(float v, float min, float max) {
+    if (v < min) return v - min;
+    else if (v > max) return v - max;
 
     return 0.0f;
 }
 
-TextSelect::Selection TextSelect::getSelection() const {
-    // Start and end may be out of order (ordering is based on Y position)
-    bool startBeforeEnd = selectStart.y < selectEnd.y || (selectStart.y == selectEnd.y && selectStart.x < selectEnd.x);
+// Gets the scroll delta for a distance outside of the window over a frame.
+// The cursor has been outside of the window for timeStart seconds at the start of the frame. The multiplier increases
+// linearly over time, so its average over the frame gives the exact distance for the frame at any frame rate.
+static float getScrollDelta(const TextSelect::AutoscrollPolicy& policy, float distance, float timeStart,
+    float deltaTime) {
+    float speed = std::min(std::abs(distance) * policy.speed, policy.maxSpeed);
+    float multiplier = 1.0f + policy.acceleration * (timeStart + deltaTime / 2);
 
-    // Reorder X points if necessary
-    std::size_t startX = startBeforeEnd ? selectStart.x : selectEnd.x;
-    std::size_t endX = startBeforeEnd ? selectEnd.x : selectStart.x;
+    return std::copysign(speed * std::min(multiplier, policy.maxMultiplier) * deltaTime, distance);
+}
 
-    // Get min and max Y positions for start and end
-    std::size_t startY = std::min(selectStart.y, selectEnd.y);
-    std::size_t endY = std::max(selectStart.y, selectEnd.y);
+// Calls a function with the start and end byte offsets of each row of a line wrapped at the given width.
+// Rows cover the entire line with no gaps, blanks skipped at the start of a row by Dear ImGui's wrapping are included
+// at the end of the previous row. The function returns false to stop iterating.
+// Wrap positions only read the font's glyph advance tables, so this can be used from worker threads.
+template <class F>
+static void forEachWrapRow(ImFont* font, float scale, std::string_view s, float wrapWidth, F&& callback) {
+    TEXTSELECT_COUNT(bytesMeasured, s.size());
+    const char* begin = s.data();
+    const char* end = s.data() + s.size();
+    const char* rowStart = begin;
+    do {
+        // Row end as computed by ImFont::CalcTextSizeA, which always puts at least one character in a row
+        const char* rowEnd = font->CalcWordWrapPositionA(scale, rowStart, end, wrapWidth);
+        if (rowEnd <= rowStart && rowStart < end) rowEnd = rowStart + 1;
+
+        // Wrapping skips upcoming blanks and the newline afterwards
+        while (rowEnd < end && (*rowEnd == ' ' || *rowEnd == '\t')) rowEnd++;
+        if (rowEnd < end && *rowEnd == '\n') rowEnd++;
+
+        if (!callback(static_cast<std::size_t>(rowStart - begin), static_cast<std::size_t>(rowEnd - begin))) return;
+        rowStart = rowEnd;
+    } while (rowStart < end);
+}
 
-    return { startX, startY, endX, endY };
+// Calls a function with the byte offsets of each row of a line wrapped at the given width with the current font.
+template <class F>
+static void forEachWrapRow(std::string_view s, float wrapWidth, F&& callback) {
+    ImFont* font = ImGui::GetFont();
+    forEachWrapRow(font, ImGui::GetFontSize() / font->FontSize, s, wrapWidth, std::forward<F>(callback));
 }
 
-void TextSelect::handleMouseDown(const ImVec2& cursorPosStart) {
-    const float textHeight = ImGui::GetTextLineHeightWithSpacing();
-    ImVec2 mousePos = ImGui::GetMousePos() - cursorPosStart;
+void TextSelect::resolveConfig() {
+    const float rowHeight = config.rowHeight < 0 ? ImGui::GetTextLineHeight() : config.rowHeight;
+    const float spacing = config.lineSpacing < 0 ? ImGui::GetTextLineHeightWithSpacing() - ImGui::GetTextLineHeight()
+                                                 : config.lineSpacing;
+
+    // The width of the space character is used for the width of newlines
+    frameMetrics.newlineWidth = config.newlineWidth < 0 ? ImGui::CalcTextSize(" ").x : config.newlineWidth;
+    frameMetrics.rowHeight = rowHeight;
+    frameMetrics.lineHeight = rowHeight + spacing;
+    frameMetrics.selectionColor = config.selectionColor == 0 ? ImGui::GetColorU32(ImGuiCol_TextSelectedBg)
+                                                             : config.selectionColor;
+    frameMetrics.highlightColor = config.highlightColor == 0 ? ImGui::GetColorU32(ImGuiCol_TextSelectedBg, 0.5f)
+                                                             : config.highlightColor;
+    frameMetrics.textColor = config.textColor == 0 ? ImGui::GetColorU32(ImGuiCol_Text) : config.textColor;
+}
 
-    // Get Y position of mouse cursor, in terms of line number (capped to the index of the last line)
-    std::size_t y = std::min(static_cast<std::size_t>(std::floor(mousePos.y / textHeight)), getNumLines() - 1);
-    if (y < 0) return;
+void TextSelect::validateCaches() {
+    ImFont* font = ImGui::GetFont();
+    const float fontSize = ImGui::GetFontSize();
+    bool sameMetrics = frameMetrics.newlineWidth == cacheMetrics.newlineWidth
+        && frameMetrics.rowHeight == cacheMetrics.rowHeight && frameMetrics.lineHeight == cacheMetrics.lineHeight;
+    if (font == cacheFont && fontSize == cacheFontSize && sameMetrics) return;
+
+    // Measurements are only valid for the font and spacing they were made with
+    clearMeasurements();
+
+    // Check if the monospace fast path can be used
+    const float scale = fontSize / font->FontSize;
+    const float detectedAdvance = getMonospaceAdvance(font, scale, false);
+    if (monospaceMode == MonospaceMode::Off) monospaceAdvance = 0.0f;
+    else if (monospaceMode == MonospaceMode::On) monospaceAdvance = getMonospaceAdvance(font, scale, true);
+    else monospaceAdvance = detectedAdvance;
+
+    // Runs of printable ASCII characters can only be skipped if they all have the monospace advance
+    monospaceAsciiRuns = monospaceAdvance > 0 && detectedAdvance == monospaceAdvance;
+
+    cacheFont = font;
+    cacheFontSize = fontSize;
+    cacheMetrics = frameMetrics;
+}
 
-    std::string_view currentLine = getLineAtIdx(y);
-    std::size_t x = getCharIndex(currentLine, mousePos.x);
+TextSelect::CharClass TextSelect::classifyChar(char32_t c) const {
+    return config.classifier ? config.classifier(c) : getCharClass(c);
+}
 
-    // Get mouse click count and determine action
-    if (int mouseClicks = ImGui::GetMouseClickedCount(ImGuiMouseButton_Left); mouseClicks > 0) {
-        if (mouseClicks % 3 == 0) {
-            // Triple click - select line
-            selectStart = { 0, y };
-            selectEnd = { utf8Length(currentLine), y };
-        } else if (mouseClicks % 2 == 0) {
-            // Double click - select word
-            // Initialize start and end iterators to current cursor position
-            utf8::unchecked::iterator startIt{ currentLine.data() };
-            utf8::unchecked::iterator endIt{ currentLine.data() };
-            for (std::size_t i = 0; i < x; i++) {
-                startIt++;
-                endIt++;
+TextSelect::CharClass TextSelect::getCharClass(char32_t c) {
+    if (c < 0x10000) return classTable.blocks[classTable.blockIndex[c / classBlockSize]][c % classBlockSize];
+
+    // Supplementary planes
+    if (c >= 0x1F000 && c <= 0x1FBFF) return Punctuation; // Emoji and other symbols
+    if (c >= 0x20000 && c <= 0x3FFFF) return Ideograph; // CJK unified ideographs extensions
+    if (c >= 0xE0000) return Space; // Tags, variation selectors, and private use
+    return Word;
+}
+
+// Measures a line for its metrics with the current font, specialized for an encoding.
+template <Encoding E, class Metrics>
+static void buildLineMetrics(Metrics& metrics, std::string_view line, float monospaceAdvance, bool asciiRuns) {
+    TEXTSELECT_COUNT(cacheMisses, 1);
+    TEXTSELECT_COUNT(bytesMeasured, line.size());
+    auto& [widths, segments, advance] = metrics;
+    widths.clear();
+    segments.clear();
+    advance = monospaceAdvance;
+
+    ImFont* font = ImGui::GetFont();
+    const float scale = ImGui::GetFontSize() / font->FontSize;
+    const char* begin = line.data();
+    const char* end = line.data() + line.size();
+
+    // Measure each character once and accumulate the widths
+    float x = 0.0f;
+    if (advance > 0) {
+        // Start a new segment for each character without the monospace advance and for each run of characters after
+        bool inRun = false;
+        for (const char* it = begin; it != end;) {
+            // Printable ASCII characters all have the monospace advance if asciiRuns is set, so runs of them can be
+            // skipped without measuring each one
+            if (asciiRuns) {
+                const char* runEnd = skipPrintableAscii(it, end);
+                if (runEnd != it) {
+                    if (!inRun) segments.push_back({ static_cast<std::size_t>(it - begin), x, true });
+                    inRun = true;
+                    x += static_cast<float>(runEnd - it) * advance;
+                    it = runEnd;
+                    continue;
+                }
             }
 
-            bool isCurrentBoundary = isBoundary(*startIt);
+            const char* charStart = it;
+            float charWidth = getCharWidth(font, scale, nextChar<E>(it));
+            bool isRunChar = it - charStart == 1 && charWidth == advance;
+
+            if (!isRunChar || !inRun) segments.push_back({ static_cast<std::size_t>(charStart - begin), x, isRunChar });
+            inRun = isRunChar;
+            x += charWidth;
+        }
 
-            // Scan to left until a word boundary is reached
-            for (std::size_t startInv = 0; startInv <= x; startInv++) {
-                if (isBoundary(*startIt) != isCurrentBoundary) break;
-                selectStart = { x - startInv, y };
-                startIt--;
+        segments.push_back({ line.size(), x, false });
+    } else {
+        // All bytes of a character get the position where the character starts
+        widths.resize(line.size() + 1);
+        for (const char* it = begin; it != end;) {
+            // ASCII characters are single bytes, so they don't need to be decoded
+            // Text known to be ASCII doesn't need to be scanned for them.
+            const char* asciiEnd = E == Encoding::ASCII ? end : skipAscii(it, end);
+            for (; it != asciiEnd; it++) {
+                widths[static_cast<std::size_t>(it - begin)] = x;
+                x += getCharWidth(font, scale, static_cast<char32_t>(*it));
             }
+            if (it == end) break;
+
+            const char* charStart = it;
+            float charWidth = getCharWidth(font, scale, nextChar<E>(it));
+
+            std::fill(widths.begin() + (charStart - begin), widths.begin() + (it - begin), x);
+            x += charWidth;
+        }
+
+        widths.back() = x;
+    }
+}
+
+void TextSelect::LineMetrics::build(std::string_view line, float monospaceAdvance, bool asciiRuns, Encoding encoding) {
+    if (encoding == Encoding::ASCII) buildLineMetrics<Encoding::ASCII>(*this, line, monospaceAdvance, asciiRuns);
+    else buildLineMetrics<Encoding::UTF8>(*this, line, monospaceAdvance, asciiRuns);
+}
+
+float TextSelect::LineMetrics::getPosX(std::size_t byteIdx) const {
+    if (advance <= 0) return widths[std::min(byteIdx, widths.size() - 1)];
+
+    // Find the segment containing the byte, positions in runs are calculated from the advance
+    auto it = std::upper_bound(segments.begin(), segments.end(), byteIdx,
+        [](std::size_t byte, const Segment& segment) { return byte < segment.byte; });
 
-            // Scan to right until a word boundary is reached
-            for (std::size_t end = x; end <= utf8Length(currentLine); end++) {
-                selectEnd = { end, y };
-                if (isBoundary(*endIt) != isCurrentBoundary) break;
-                endIt++;
+    const Segment& segment = *(it - 1);
+    if (!segment.isRun) return segment.x;
+    return segment.x + static_cast<float>(byteIdx - segment.byte) * advance;
+}
+
+std::size_t TextSelect::LineMetrics::getCharAt(std::string_view line, float posX, std::size_t rowStart,
+    std::size_t rowEnd) const {
+    if (advance <= 0) {
+        // The character under the cursor is the last one in the row starting at or before the cursor position
+        // The search starts after the row's first position, so the result is never before the row start. The result
+        // may be on a continuation byte, so it is moved back to the start of its character.
+        auto it = std::upper_bound(widths.begin() + rowStart + 1, widths.begin() + rowEnd + 1, posX);
+        return getCharStart(line, static_cast<std::size_t>(it - widths.begin()) - 1);
+    }
+
+    // Find the last segment starting at or before the cursor position
+    auto it = std::upper_bound(segments.begin(), segments.end(), posX,
+        [](float x, const Segment& segment) { return x < segment.x; });
+
+    // In runs, the character is found from the advance
+    const Segment& segment = *(it == segments.begin() ? it : it - 1);
+    std::size_t byteIdx = segment.byte;
+    if (segment.isRun) {
+        std::size_t runLength = (it == segments.end() ? line.size() : it->byte) - segment.byte;
+        auto column = static_cast<std::size_t>(std::max(posX - segment.x, 0.0f) / advance);
+        byteIdx += std::min(column, runLength - 1);
+    }
+
+    return std::clamp(byteIdx, rowStart, rowEnd);
+}
+
+std::size_t TextSelect::MetricsCache::KeyHash::operator()(const Key& key) const {
+    // The content hash is already well distributed, so the other fields are just mixed in
+    std::size_t hash = key.hash;
+    for (std::size_t field : { std::hash<const ImFont*>{}(key.font), std::hash<float>{}(key.fontSize),
+             std::hash<float>{}(key.monospaceAdvance), key.size })
+        hash ^= field + 0x9E3779B97F4A7C15 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+const TextSelect::LineMetrics& TextSelect::MetricsCache::get(const Key& key, std::string_view line, bool asciiRuns,
+    Encoding encoding) {
+    // Move found entries to the front of the list
+    if (auto it = index.find(key); it != index.end()) {
+        TEXTSELECT_COUNT(cacheHits, 1);
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->metrics;
+    }
+
+    Entry& entry = entries.emplace_front(Entry{ key, {}, 0 });
+    entry.metrics.build(line, key.monospaceAdvance, asciiRuns, encoding);
+    entry.bytes = sizeof(Entry) + entry.metrics.widths.capacity() * sizeof(float)
+        + entry.metrics.segments.capacity() * sizeof(LineMetrics::Segment);
+
+    index[key] = entries.begin();
+    usedBytes += entry.bytes;
+
+    // Drop the least recently used entries, the new entry is always kept
+    while (usedBytes > maxBytes && entries.size() > 1) {
+        usedBytes -= entries.back().bytes;
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+
+    return entry.metrics;
+}
+
+const TextSelect::LineMetrics* TextSelect::getLineMetrics(std::size_t lineIdx, std::string_view line) const {
+    if (metricsCache) {
+        // Keep the hashes bounded like the width cache
+        std::size_t key = lineIdx + removedLines;
+        auto it = lineHashes.find(key);
+        if (it == lineHashes.end()) {
+            if (lineHashes.size() >= maxCachedLines) lineHashes.clear();
+            it = lineHashes.emplace(key, std::hash<std::string_view>{}(line)).first;
+        }
+
+        MetricsCache::Key cacheKey{ cacheFont, cacheFontSize, monospaceAdvance, it->second, line.size() };
+        return &metricsCache->get(cacheKey, line, monospaceAsciiRuns, encoding);
+    }
+
+    if (!widthCacheEnabled) {
+        // Proportional fonts are measured by Dear ImGui when the cache is disabled
+        if (monospaceAdvance <= 0) return nullptr;
+
+        // Monospace metrics are quick to build, keep the last line's metrics since lines are often measured repeatedly
+        if (lineIdx != scratchLineIdx) {
+            scratchMetrics.build(line, monospaceAdvance, monospaceAsciiRuns, encoding);
+            scratchLineIdx = lineIdx;
+        } else {
+            TEXTSELECT_COUNT(cacheHits, 1);
+        }
+        return &scratchMetrics;
+    }
+
+    // Cache entries are keyed by absolute line number so they stay valid when lines are removed from the front
+    std::size_t key = lineIdx + removedLines;
+    if (auto it = widthCache.find(key); it != widthCache.end()) {
+        TEXTSELECT_COUNT(cacheHits, 1);
+        return &it->second;
+    }
+
+    // Keep the cache bounded, lines are re-measured as they are needed
+    if (widthCache.size() >= maxCachedLines) widthCache.clear();
+
+    LineMetrics& metrics = widthCache[key];
+    metrics.build(line, monospaceAdvance, monospaceAsciiRuns, encoding);
+    return &metrics;
+}
+
+float TextSelect::getCharPosX(std::size_t lineIdx, std::string_view line, std::size_t byteIdx,
+    std::size_t rowStart) const {
+    if (const LineMetrics* metrics = getLineMetrics(lineIdx, line))
+        return roundTextWidth(metrics->getPosX(byteIdx) - metrics->getPosX(rowStart));
+
+    return substringSizeX(line, rowStart, byteIdx);
+}
+
+std::size_t TextSelect::getCharIndexAt(std::size_t lineIdx, std::string_view line, float posX, std::size_t rowStart,
+    std::size_t rowEnd, const LineMetrics* metrics) const {
+    rowEnd = std::min(rowEnd, line.size());
+    rowStart = std::min(rowStart, rowEnd);
+
+    // Ignore cursor position when it is invalid
+    if (posX < 0) return rowStart;
+
+    if (!metrics) metrics = getLineMetrics(lineIdx, line);
+    if (!metrics) {
+        std::string_view row = line.substr(rowStart, rowEnd - rowStart);
+        return rowStart + (encoding == Encoding::ASCII ? getCharIndex<Encoding::ASCII>(row, posX)
+                                                       : getCharIndex<Encoding::UTF8>(row, posX));
+    }
+
+    // Measured widths are rounded up to whole pixels, and a rounded width is at most posX if the unrounded width is at
+    // most posX rounded down, so the unrounded positions can be searched
+    return metrics->getCharAt(line, std::floor(posX) + metrics->getPosX(rowStart), rowStart, rowEnd);
+}
+
+void TextSelect::extendLineOffsets(std::size_t count) const {
+    const float fontHeight = frameMetrics.rowHeight;
+    const float spacing = frameMetrics.lineHeight - fontHeight;
+
+    // Each line takes up the height of its rows, plus item spacing after the last row
+    while (lineOffsetsY.size() <= count) {
+        // Use the lines counted by precomputation workers if they are ready
+        if (mergePrecomputedLines()) continue;
+
+        std::size_t first = lineOffsetsY.size() - 1;
+        for (std::string_view line : lineSource.lines(first, std::min(lineFetchSize, count - first))) {
+            std::size_t rows = 0;
+            forEachWrapRow(line, wrapWidth, [&rows](std::size_t, std::size_t) { return ++rows; });
+            lineOffsetsY.push_back(lineOffsetsY.back() + static_cast<double>(rows) * fontHeight + spacing);
+        }
+
+        // Workers skip the chunks indexed here
+        if (GeometryJob* job = geometryJob.get())
+            job->indexedLines.store(lineOffsetsY.size() - 1 - job->firstLine, std::memory_order_relaxed);
+    }
+}
+
+void TextSelect::runGeometryJob(std::stop_token stopToken, GeometryJob& job, LineSource source, ImFont* font,
+    float scale, float wrapWidth) {
+    try {
+        for (std::size_t chunk; (chunk = job.nextChunk.fetch_add(1)) < job.chunkRows.size();) {
+            std::size_t first = chunk * precomputeChunkSize;
+            std::size_t count = std::min(precomputeChunkSize, job.numLines - first);
+
+            // The main thread measured these lines itself while they were waiting
+            if (first + count <= job.indexedLines.load(std::memory_order_relaxed)) {
+                job.chunkDone[chunk].store(true, std::memory_order_release);
+                continue;
+            }
+
+            std::vector<std::uint32_t>& rows = job.chunkRows[chunk];
+            rows.reserve(count);
+            for (std::size_t i = 0; i < count; i += lineFetchSize) {
+                if (stopToken.stop_requested()) return;
+
+                std::size_t fetchCount = std::min(lineFetchSize, count - i);
+                for (std::string_view line : source.lines(job.sourceFirstLine + first + i, fetchCount)) {
+                    std::uint32_t numRows = 0;
+                    forEachWrapRow(font, scale, line, wrapWidth, [&numRows](std::size_t, std::size_t) {
+                        return ++numRows;
+                    });
+                    rows.push_back(numRows);
+                }
             }
-        } else if (ImGui::IsKeyDown(ImGuiMod_Shift)) {
+
+            job.chunkDone[chunk].store(true, std::memory_order_release);
+        }
+    } catch (const std::bad_alloc&) {
+        // Lines in unfinished chunks are measured by the main thread when they are needed
+    }
+}
+
+void TextSelect::startPrecompute(std::size_t numLines) {
+    std::size_t indexedLines = lineOffsetsY.size() - 1;
+    if (geometryJob || precomputeThreads == 0 || wrapWidth <= 0 || indexedLines >= numLines) return;
+
+    // Smaller texts are quicker to measure on the main thread when their lines are needed
+    if (numLines - indexedLines < minPrecomputeLines) return;
+
+    // The job continues from the end of the index, which is where the next lines are needed
+    geometryJob = std::make_unique<GeometryJob>();
+    GeometryJob& job = *geometryJob;
+    job.firstLine = indexedLines;
+    job.numLines = std::min(numLines - indexedLines, maxPrecomputeLines);
+    job.sourceFirstLine = indexedLines;
+
+    // Vectors can reallocate when lines are added, so the workers read a copy of the job's lines
+    LineSource source = lineSource;
+    if (lineSource.vector) {
+        auto first = lineSource.vector->begin() + static_cast<std::ptrdiff_t>(indexedLines);
+        job.lines.assign(first, first + static_cast<std::ptrdiff_t>(job.numLines));
+        job.sourceFirstLine = 0;
+        source.vector = &job.lines;
+    }
+
+    std::size_t numChunks = (job.numLines + precomputeChunkSize - 1) / precomputeChunkSize;
+    job.chunkRows.resize(numChunks);
+    job.chunkDone = std::make_unique<std::atomic<bool>[]>(numChunks);
+
+    // The current font can't be queried from other threads, the workers are given the font and its scale
+    // A change to either clears the index, which cancels the job.
+    ImFont* font = ImGui::GetFont();
+    const float scale = ImGui::GetFontSize() / font->FontSize;
+    for (std::size_t i = 0; i < std::min(precomputeThreads, numChunks); i++)
+        job.threads.emplace_back(runGeometryJob, std::ref(job), source, font, scale, wrapWidth);
+}
+
+bool TextSelect::mergePrecomputedLines() const {
+    const float fontHeight = frameMetrics.rowHeight;
+    const float spacing = frameMetrics.lineHeight - fontHeight;
+
+    bool merged = false;
+    while (geometryJob) {
+        GeometryJob& job = *geometryJob;
+        std::size_t jobLine = lineOffsetsY.size() - 1 - job.firstLine;
+
+        // The workers have nothing left to do once all lines of the job are indexed
+        if (jobLine >= job.numLines) {
+            geometryJob.reset();
+            break;
+        }
+
+        // Chunks are added in order, the index can end in the middle of a chunk the main thread started
+        std::size_t chunk = jobLine / precomputeChunkSize;
+        if (!job.chunkDone[chunk].load(std::memory_order_acquire)) break;
+
+        std::vector<std::uint32_t>& rows = job.chunkRows[chunk];
+        for (std::size_t i = jobLine % precomputeChunkSize; i < rows.size(); i++)
+            lineOffsetsY.push_back(lineOffsetsY.back() + static_cast<double>(rows[i]) * fontHeight + spacing);
+
+        rows = {};
+        job.indexedLines.store(lineOffsetsY.size() - 1 - job.firstLine, std::memory_order_relaxed);
+        merged = true;
+    }
+
+    return merged;
+}
+
+float TextSelect::getLineY(std::size_t lineIdx) const {
+    if (wrapWidth <= 0) return static_cast<float>(lineIdx) * frameMetrics.lineHeight;
+
+    extendLineOffsets(lineIdx);
+    return static_cast<float>(lineOffsetsY[lineIdx] - lineOffsetsBaseY);
+}
+
+std::size_t TextSelect::getLineAtY(float posY, std::size_t numLines) const {
+    // Positions above the first line are treated as being on the first line
+    posY = std::max(posY, 0.0f);
+
+    if (wrapWidth <= 0) {
+        std::size_t line = static_cast<std::size_t>(std::floor(posY / frameMetrics.lineHeight));
+        return std::min(line, numLines - 1);
+    }
+
+    // Index lines until the position is reached, then find the line containing it
+    double indexY = posY + lineOffsetsBaseY;
+    while (lineOffsetsY.size() <= numLines && lineOffsetsY.back() <= indexY)
+        extendLineOffsets(std::min(lineOffsetsY.size() - 1 + lineFetchSize, numLines));
+
+    auto indexEnd = lineOffsetsY.begin() + static_cast<std::ptrdiff_t>(std::min(lineOffsetsY.size(), numLines + 1));
+    auto it = std::upper_bound(lineOffsetsY.begin(), indexEnd, indexY);
+    return std::min(static_cast<std::size_t>(it - lineOffsetsY.begin()) - 1, numLines - 1);
+}
+
+float TextSelect::getContentHeight(std::size_t numLines) const {
+    if (numLines == 0) return 0.0f;
+
+    // ImGui doesn't add spacing after the last item
+    const float spacing = frameMetrics.lineHeight - frameMetrics.rowHeight;
+    if (wrapWidth <= 0) return static_cast<float>(numLines) * frameMetrics.lineHeight - spacing;
+
+    std::size_t indexedLines = std::min(lineOffsetsY.size() - 1, numLines);
+    double indexedHeight = lineOffsetsY[indexedLines] - lineOffsetsBaseY;
+    double estimatedHeight = static_cast<double>(numLines - indexedLines) * frameMetrics.lineHeight;
+    return static_cast<float>(indexedHeight + estimatedHeight) - spacing;
+}
+
+std::array<std::size_t, 2> TextSelect::getVisibleLines(const ImVec2& cursorPosStart, std::size_t numLines) const {
+    // This is the same computation ImGuiListClipper uses to skip items outside of the visible area
+    const ImRect& clipRect = ImGui::GetCurrentWindowRead()->ClipRect;
+    return { getLineAtY(clipRect.Min.y - cursorPosStart.y, numLines),
+        getLineAtY(clipRect.Max.y - cursorPosStart.y, numLines) };
+}
+
+std::span<const std::string_view> TextSelect::LineSource::lines(std::size_t first, std::size_t count) const {
+    if (vector) return std::span{ *vector }.subspan(first, count);
+    if (object) return objectLines(object, first, count);
+
+    // Accessor functions only give one line at a time, collect them in the buffer
+    buffer.resize(count);
+    if (getLineAtIdxPtr) {
+        for (std::size_t i = 0; i < count; i++) buffer[i] = getLineAtIdxPtr(first + i, userData);
+    } else {
+        for (std::size_t i = 0; i < count; i++) buffer[i] = getLineAtIdx(first + i);
+    }
+    return buffer;
+}
+
+// Gets the sort key of a selection in an index of selections, ordered by start position.
+static std::array<std::size_t, 4> selectionKey(const TextSelect::Selection& selection) {
+    return { selection.startY, selection.startX, selection.endY, selection.endX };
+}
+
+// Builds an implicit interval tree over the items in an index of selections, which must be sorted by start position.
+// This is a binary tree stored in an array with the items as its leaves (node i has children 2i and 2i + 1, and the
+// leaves start at the first power of two after the last item). Each node has the largest end line of the items below
+// it plus one, so it is 0 for nodes without items.
+template <class T>
+static void buildEndYTree(const std::pmr::vector<T>& items, std::pmr::vector<std::size_t>& tree) {
+    std::size_t numLeaves = std::bit_ceil(std::max<std::size_t>(items.size(), 1));
+    tree.assign(2 * numLeaves, 0);
+    for (std::size_t i = 0; i < items.size(); i++)
+        tree[numLeaves + i] = std::min(items[i].selection.endY, std::string_view::npos - 1) + 1;
+
+    for (std::size_t i = numLeaves - 1; i > 0; i--) tree[i] = std::max(tree[2 * i], tree[2 * i + 1]);
+}
+
+// Calls a function with each item below a node of an interval tree that is before the end index and ends at or after
+// the first line, from left to right. Subtrees without such items are skipped.
+template <class T, class F>
+static void visitEndYTree(const std::pmr::vector<T>& items, const std::pmr::vector<std::size_t>& tree, std::size_t node,
+    std::size_t nodeBegin, std::size_t nodeSize, std::size_t end, std::size_t firstLine, F& callback) {
+    if (nodeBegin >= end || tree[node] <= firstLine) return;
+
+    if (nodeSize == 1) {
+        callback(items[nodeBegin]);
+        return;
+    }
+
+    std::size_t half = nodeSize / 2;
+    visitEndYTree(items, tree, 2 * node, nodeBegin, half, end, firstLine, callback);
+    visitEndYTree(items, tree, 2 * node + 1, nodeBegin + half, half, end, firstLine, callback);
+}
+
+// Calls a function with each item in an index of selections that intersects a range of lines (inclusive), in order.
+// Items starting after the last line are found with a binary search, and the interval tree skips every subtree of the
+// others that ends before the first line, so this takes logarithmic time for each item found.
+template <class T, class F>
+static void forEachInLines(const std::pmr::vector<T>& items, const std::pmr::vector<std::size_t>& tree,
+    std::size_t firstLine, std::size_t lastLine, F&& callback) {
+    auto end = std::upper_bound(items.begin(), items.end(), lastLine,
+        [](std::size_t line, const T& item) { return line < item.selection.startY; });
+    if (end == items.begin()) return;
+
+    std::size_t numLeaves = tree.size() / 2;
+    visitEndYTree(items, tree, 1, 0, numLeaves, static_cast<std::size_t>(end - items.begin()), firstLine, callback);
+}
+
+// Moves a selection to account for lines removed from the front of the text, keeping it on the same text.
+// Returns false if the selection was entirely in the removed lines.
+static bool removeFrontLines(TextSelect::Selection& selection, std::size_t count) {
+    if (selection.endY < count) return false;
+
+    if (selection.startY >= count) selection.startY -= count;
+    else selection.startX = selection.startY = 0;
+
+    selection.endY -= count;
+    return true;
+}
+
+// Creates a selection between two positions, with start and end in order (ordering is based on Y position).
+static TextSelect::Selection makeSelection(std::size_t x1, std::size_t y1, std::size_t x2, std::size_t y2) {
+    bool firstBeforeSecond = y1 < y2 || (y1 == y2 && x1 < x2);
+    if (firstBeforeSecond) return { x1, y1, x2, y2 };
+    return { x2, y2, x1, y1 };
+}
+
+TextSelect::Selection TextSelect::getSelection() const {
+    constexpr std::size_t npos = std::string_view::npos;
+    if (!hasSelection()) return { npos, npos, npos, npos };
+
+    // Start and end may be out of order (the user can click and drag left/up which reverses start and end)
+    return makeSelection(selectStart.x, selectStart.y, selectEnd.x, selectEnd.y);
+}
+
+void TextSelect::setSelection(const Selection& selection) {
+    selectStart = { selection.startX, selection.startY };
+    selectEnd = { selection.endX, selection.endY };
+    blockSelection = false;
+    keyboardPosX = -1.0f;
+}
+
+void TextSelect::clearSelection() {
+    selectStart = {};
+    selectEnd = {};
+    blockSelection = false;
+}
+
+void TextSelect::setAnchor(std::string_view name, const Selection& selection) {
+    Selection ordered = makeSelection(selection.startX, selection.startY, selection.endX, selection.endY);
+    if (auto it = anchors.find(name); it != anchors.end()) it->second = ordered;
+    else anchors.emplace(name, ordered);
+
+    anchorIndexDirty = true;
+}
+
+void TextSelect::removeAnchor(std::string_view name) {
+    if (auto it = anchors.find(name); it != anchors.end()) {
+        anchors.erase(it);
+        anchorIndexDirty = true;
+    }
+}
+
+void TextSelect::clearAnchors() {
+    anchors.clear();
+    anchorIndexDirty = true;
+}
+
+const TextSelect::Selection* TextSelect::getAnchor(std::string_view name) const {
+    auto it = anchors.find(name);
+    return it == anchors.end() ? nullptr : &it->second;
+}
+
+void TextSelect::buildAnchorIndex() const {
+    if (!anchorIndexDirty) return;
+
+    anchorIndex.clear();
+    for (const auto& [name, selection] : anchors) anchorIndex.push_back({ name, selection });
+
+    // Anchors at the same position are ordered by name, since the map has no order
+    std::sort(anchorIndex.begin(), anchorIndex.end(), [](const Anchor& a, const Anchor& b) {
+        return std::pair{ selectionKey(a.selection), a.name } < std::pair{ selectionKey(b.selection), b.name };
+    });
+
+    buildEndYTree(anchorIndex, anchorEndYTree);
+    anchorIndexDirty = false;
+}
+
+void TextSelect::forEachAnchorInLines(std::size_t firstLine, std::size_t lastLine,
+    const std::function<void(const Anchor&)>& callback) const {
+    buildAnchorIndex();
+    forEachInLines(anchorIndex, anchorEndYTree, firstLine, lastLine, callback);
+}
+
+void TextSelect::addHighlight(const Selection& selection, ImU32 color) {
+    highlights.push_back({ makeSelection(selection.startX, selection.startY, selection.endX, selection.endY), color });
+    highlightsDirty = true;
+}
+
+void TextSelect::setHighlights(std::span<const Highlight> newHighlights) {
+    highlights.clear();
+    for (const Highlight& highlight : newHighlights) addHighlight(highlight.selection, highlight.color);
+    highlightsDirty = true;
+}
+
+void TextSelect::clearHighlights() {
+    highlights.clear();
+    highlightsDirty = true;
+}
+
+void TextSelect::forEachVisibleAnchor(const std::function<void(const Anchor&)>& callback) const {
+    std::size_t numLines = lineSource.numLines();
+    if (numLines == 0) return;
+
+    auto [firstVisible, lastVisible] = getVisibleLines(ImGui::GetWindowPos() + ImGui::GetCursorStartPos(), numLines);
+    forEachAnchorInLines(firstVisible, lastVisible, callback);
+}
+
+std::array<std::size_t, 2> TextSelect::getBlockColumns(std::size_t lineIdx, std::string_view line) const {
+    // The columns are the characters between the positions, the same way a selection is made in a single line
+    auto [minX, maxX] = std::minmax(blockStartX, blockEndX);
+    std::size_t start = getCharIndexAt(lineIdx, line, minX, 0, line.size());
+    std::size_t end = getCharIndexAt(lineIdx, line, maxX, 0, line.size());
+    return { start, std::max(start, end) };
+}
+
+TextSelect::CursorPos TextSelect::getCursorPosAt(const ImVec2& pos, std::size_t numLines) const {
+    // Get Y position in terms of line number (capped to the index of the last line)
+    std::size_t y = getLineAtY(pos.y, numLines);
+    return getCursorPosInLine(pos, y, lineSource.line(y), nullptr);
+}
+
+TextSelect::CursorPos TextSelect::getCursorPosInLine(const ImVec2& pos, std::size_t y, std::string_view currentLine,
+    const LineMetrics* metrics) const {
+    // Get the wrapped row of the line the position is on
+    std::size_t rowStart = 0;
+    std::size_t rowEnd = currentLine.size();
+    if (wrapWidth > 0) {
+        float rowY = std::max(pos.y - getLineY(y), 0.0f);
+        auto rowIdx = static_cast<std::size_t>(std::floor(rowY / frameMetrics.rowHeight));
+
+        // Rows past the last row are treated as being on the last row
+        forEachWrapRow(currentLine, wrapWidth, [&](std::size_t start, std::size_t end) {
+            rowStart = start;
+            rowEnd = end;
+            return rowIdx-- > 0;
+        });
+    }
+
+    return { getCharIndexAt(y, currentLine, pos.x, rowStart, rowEnd, metrics), y };
+}
+
+std::span<const TextSelect::CursorPos> TextSelect::hitTest(std::span<const ImVec2> points) const {
+    TEXTSELECT_ZONE("TextSelect::hitTest");
+    hitTestResults.assign(points.size(), CursorPos{});
+
+    std::size_t numLines = lineSource.numLines();
+    if (numLines == 0) return hitTestResults;
+
+    // Sort the points by line so points on the same line are together
+    ImVec2 cursorPosStart = ImGui::GetWindowPos() + ImGui::GetCursorStartPos();
+    hitTestOrder.clear();
+    for (std::size_t i = 0; i < points.size(); i++)
+        hitTestOrder.push_back({ getLineAtY(points[i].y - cursorPosStart.y, numLines), i });
+    std::sort(hitTestOrder.begin(), hitTestOrder.end());
+
+    for (auto it = hitTestOrder.begin(); it != hitTestOrder.end();) {
+        std::size_t lineIdx = (*it)[0];
+        auto lineEnd = std::find_if(it, hitTestOrder.end(),
+            [lineIdx](const std::array<std::size_t, 2>& query) { return query[0] != lineIdx; });
+        std::string_view line = lineSource.line(lineIdx);
+
+        // Lines that would be measured by Dear ImGui for each point are measured once instead if they have more than
+        // one point
+        const LineMetrics* metrics = getLineMetrics(lineIdx, line);
+        if (!metrics && lineEnd - it > 1) {
+            scratchMetrics.build(line, 0.0f, false, encoding);
+            scratchLineIdx = std::string_view::npos;
+            metrics = &scratchMetrics;
+        }
+
+        for (; it != lineEnd; ++it)
+            hitTestResults[(*it)[1]] = getCursorPosInLine(points[(*it)[1]] - cursorPosStart, lineIdx, line, metrics);
+    }
+
+    return hitTestResults;
+}
+
+std::array<ImVec2, 2> TextSelect::getCharRect(const CursorPos& pos) const {
+    if (pos.isInvalid() || pos.y >= lineSource.numLines()) return { ImVec2{}, ImVec2{} };
+
+    std::string_view line = lineSource.line(pos.y);
+    std::size_t x = std::min(pos.x, line.size());
+
+    // The character's width is the distance to the next character, the positions are in the same row
+    std::size_t next = x;
+    if (x < line.size()) {
+        const char* it = line.data() + x;
+        utf8::unchecked::next(it);
+        next = static_cast<std::size_t>(it - line.data());
+    }
+    float width = getCharPosX(pos.y, line, next) - getCharPosX(pos.y, line, x);
+
+    ImVec2 cursorPosStart = ImGui::GetWindowPos() + ImGui::GetCursorStartPos();
+    ImVec2 point = getCursorPoint({ x, pos.y });
+    ImVec2 min = cursorPosStart + ImVec2{ point.x, point.y - frameMetrics.rowHeight / 2 };
+    return { min, min + ImVec2{ width, frameMetrics.rowHeight } };
+}
+
+ImVec2 TextSelect::getCursorPoint(const CursorPos& pos) const {
+    const float rowHeight = frameMetrics.rowHeight;
+    std::string_view line = lineSource.line(pos.y);
+    std::size_t x = std::min(pos.x, line.size());
+
+    // Find the wrapped row containing the position, positions at the end of a row are at the start of the next one
+    std::size_t rowStart = 0;
+    float rowY = 0.0f;
+    if (wrapWidth > 0) {
+        forEachWrapRow(line, wrapWidth, [&](std::size_t start, std::size_t end) {
+            rowStart = start;
+            if (x < end || end >= line.size()) return false;
+
+            rowY += rowHeight;
+            return true;
+        });
+    }
+
+    return { getCharPosX(pos.y, line, x, rowStart), getLineY(pos.y) + rowY + rowHeight / 2 };
+}
+
+void TextSelect::scrollIntoView(const ImVec2& cursorPosStart, const CursorPos& start, const CursorPos& end,
+    bool center) const {
+    const float rowHeight = frameMetrics.rowHeight;
+    ImVec2 startPoint = getCursorPoint(start);
+    ImVec2 endPoint = getCursorPoint(end);
+
+    // Window-relative bounds of the text, the positions can be on different rows so their x-positions are unordered
+    ImVec2 windowPos = ImGui::GetWindowPos();
+    ImVec2 min = cursorPosStart + ImVec2{ std::min(startPoint.x, endPoint.x), startPoint.y - rowHeight / 2 };
+    ImVec2 max = cursorPosStart + ImVec2{ std::max(startPoint.x, endPoint.x), endPoint.y + rowHeight / 2 };
+
+    // Text above or left of the visible area is scrolled to the top or left edge, text below or right of it is
+    // scrolled to the bottom or right edge
+    const ImRect& clipRect = ImGui::GetCurrentWindowRead()->ClipRect;
+    const float startRatio = center ? 0.5f : 0.0f;
+    const float endRatio = center ? 0.5f : 1.0f;
+    if (min.y < clipRect.Min.y) ImGui::SetScrollFromPosY(min.y - windowPos.y, startRatio);
+    else if (max.y > clipRect.Max.y) ImGui::SetScrollFromPosY((center ? min.y : max.y) - windowPos.y, endRatio);
+
+    // Wrapped lines fit in the window horizontally
+    if (wrapWidth > 0) return;
+    if (min.x < clipRect.Min.x) ImGui::SetScrollFromPosX(min.x - windowPos.x, startRatio);
+    else if (max.x > clipRect.Max.x) ImGui::SetScrollFromPosX((center ? min.x : max.x) - windowPos.x, endRatio);
+}
+
+void TextSelect::handleMouseDown(const ImVec2& cursorPosStart, std::size_t numLines) {
+    TEXTSELECT_ZONE("TextSelect::handleMouseDown");
+    TEXTSELECT_TIME(mouseTime);
+    if (numLines == 0) return;
+
+    ImVec2 mousePos = ImGui::GetMousePos() - cursorPosStart;
+
+    // Get mouse click count
+    // While dragging, the selection can only change if the cursor moved relative to the text.
+    int mouseClicks = ImGui::GetMouseClickedCount(ImGuiMouseButton_Left);
+    if (mouseClicks == 0 && mousePos.x == lastMousePos.x && mousePos.y == lastMousePos.y) return;
+    lastMousePos = mousePos;
+    keyboardPosX = -1.0f;
+
+    auto [x, y] = getCursorPosAt(mousePos, numLines);
+
+    // Determine action from click count
+    if (mouseClicks > 0) {
+        // Only shift-clicks keep a block selection
+        bool extending = config.shiftClickExtends && ImGui::IsKeyDown(ImGuiMod_Shift);
+        if (!extending) blockSelection = false;
+
+        if (config.tripleClickSelectsLine && mouseClicks % 3 == 0) {
+            // Triple click - select line
+            selectStart = { 0, y };
+            selectEnd = { lineSource.line(y).size(), y };
+        } else if (config.doubleClickSelectsWord && mouseClicks % 2 == 0) {
+            // Double click - select word
+            auto classify = [this](char32_t c) { return classifyChar(c); };
+            std::string_view line = lineSource.line(y);
+            auto [wordStart, wordEnd] = encoding == Encoding::ASCII ? getWordBounds<Encoding::ASCII>(line, x, classify)
+                                                                    : getWordBounds(line, x, classify);
+            selectStart = { wordStart, y };
+            selectEnd = { wordEnd, y };
+        } else if (extending) {
             // Single click with shift - select text from start to click
             // The selection starts from the beginning if no start position exists
             if (selectStart.isInvalid()) selectStart = { 0, 0 };
 
             selectEnd = { x, y };
+            blockEndX = std::max(mousePos.x, 0.0f);
         } else {
             // Single click - set start position, invalidate end position
+            // With Alt held, dragging from here selects a block of columns (columns don't line up in wrapped lines)
             selectStart = { x, y };
             selectEnd = { std::string_view::npos, std::string_view::npos };
+            blockSelection = config.altDragSelectsBlock && wrapWidth <= 0 && ImGui::IsKeyDown(ImGuiMod_Alt);
+            blockStartX = blockEndX = std::max(mousePos.x, 0.0f);
         }
     } else if (ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
         // Mouse dragging - set end position
         selectEnd = { x, y };
+        blockEndX = std::max(mousePos.x, 0.0f);
     }
 }
 
-void TextSelect::handleScrolling() const {
+void TextSelect::handleKeyboard(const ImVec2& cursorPosStart, std::size_t numLines) {
+    // The selection is only extended with shift held, from the end of the selection or the position of the last click
+    const ImGuiIO& io = ImGui::GetIO();
+    if (!io.KeyShift || numLines == 0 || selectStart.isInvalid()) return;
+
+    CursorPos end = selectEnd.isInvalid() ? selectStart : selectEnd;
+    if (end.y >= numLines) return;
+
+    std::string_view line = lineSource.line(end.y);
+    end.x = std::min(end.x, line.size());
+
+    // Word movement uses Alt on macOS, like Dear ImGui's text inputs
+    bool wordMove = io.ConfigMacOSXBehaviors ? io.KeyAlt : io.KeyCtrl;
+    auto classify = [this](char32_t c) { return classifyChar(c); };
+    bool vertical = false;
+
+    if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) {
+        // Previous character or word, or the end of the previous line
+        if (end.x > 0) {
+            std::size_t charStart = getCharStart(line, end.x - 1);
+            end.x = wordMove ? getWordBounds(line, charStart, classify)[0] : charStart;
+        } else if (end.y > 0) {
+            end = { lineSource.line(end.y - 1).size(), end.y - 1 };
+        }
+    } else if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) {
+        // Next character or word, or the start of the next line
+        if (end.x < line.size()) {
+            const char* it = line.data() + end.x;
+            utf8::unchecked::next(it);
+            end.x = wordMove ? getWordBounds(line, end.x, classify)[1] : static_cast<std::size_t>(it - line.data());
+        } else if (end.y + 1 < numLines) {
+            end = { 0, end.y + 1 };
+        }
+    } else if (ImGui::IsKeyPressed(ImGuiKey_Home)) {
+        // Start of the line, or the start of the text with Ctrl
+        end = { 0, io.KeyCtrl ? 0 : end.y };
+    } else if (ImGui::IsKeyPressed(ImGuiKey_End)) {
+        // End of the line, or the end of the text with Ctrl
+        if (io.KeyCtrl) end = { lineSource.line(numLines - 1).size(), numLines - 1 };
+        else end.x = line.size();
+    } else {
+        // Up and down move by one row, page up and page down move by the height of the visible area
+        const float rowDistance = frameMetrics.lineHeight;
+        const float pageDistance = ImGui::GetCurrentWindowRead()->ClipRect.GetHeight();
+
+        float distance = 0.0f;
+        if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) distance = -rowDistance;
+        else if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) distance = rowDistance;
+        else if (ImGui::IsKeyPressed(ImGuiKey_PageUp)) distance = -pageDistance;
+        else if (ImGui::IsKeyPressed(ImGuiKey_PageDown)) distance = pageDistance;
+        else return;
+
+        // Hit-test the point above or below the current position, keeping the x-position of the first vertical move
+        ImVec2 point = getCursorPoint(end);
+        if (keyboardPosX < 0) keyboardPosX = point.x;
+
+        end = getCursorPosAt({ keyboardPosX, point.y + distance }, numLines);
+        vertical = true;
+    }
+
+    if (!vertical) keyboardPosX = -1.0f;
+    selectEnd = end;
+
+    // Block selections keep their columns when moving vertically
+    if (blockSelection && !vertical) blockEndX = getCursorPoint(end).x;
+
+    // Scroll to follow the end of the selection
+    scrollIntoView(cursorPosStart, end, end, false);
+}
+
+void TextSelect::handleScrolling() {
     // Window boundaries
     ImVec2 windowMin = ImGui::GetWindowPos();
     ImVec2 windowMax = windowMin + ImGui::GetWindowSize();
@@ -188,93 +1471,757 @@ void TextSelect::handleScrolling() const {
     // - The user is scrolling via the scrollbars
     if (activeWindow == nullptr || activeWindow->ID != currentWindow->ID || scrollbarsActive) return;
 
-    // Get scroll deltas from mouse position
+    // Get distances from mouse position, acceleration restarts if the cursor is back inside
     ImVec2 mousePos = ImGui::GetMousePos();
-    float scrollXDelta = getScrollDelta(mousePos.x, windowMin.x, windowMax.x);
-    float scrollYDelta = getScrollDelta(mousePos.y, windowMin.y, windowMax.y);
+    float distanceX = getOutsideDistance(mousePos.x, windowMin.x, windowMax.x);
+    float distanceY = getOutsideDistance(mousePos.y, windowMin.y, windowMax.y);
+    if (distanceX == 0.0f && distanceY == 0.0f) {
+        autoscrollTime = 0.0f;
+        autoscrollPages = 0.0f;
+        return;
+    }
+
+    const float deltaTime = ImGui::GetIO().DeltaTime;
+    const float timeStart = autoscrollTime;
+    autoscrollTime += deltaTime;
+
+    float scrollXDelta = 0.0f;
+    float scrollYDelta = 0.0f;
+    if (autoscrollPolicy.pagesPerSecond > 0 && autoscrollTime >= autoscrollPolicy.pageJumpDelay) {
+        // Jump by whole pages (the size of the visible area), fractions of pages are kept for the next frames
+        autoscrollPages += autoscrollPolicy.pagesPerSecond * deltaTime;
+        float pages = std::floor(autoscrollPages);
+        autoscrollPages -= pages;
+
+        const ImRect& clipRect = currentWindow->ClipRect;
+        if (distanceX != 0.0f) scrollXDelta = std::copysign(pages * clipRect.GetWidth(), distanceX);
+        if (distanceY != 0.0f) scrollYDelta = std::copysign(pages * clipRect.GetHeight(), distanceY);
+    } else {
+        scrollXDelta = getScrollDelta(autoscrollPolicy, distanceX, timeStart, deltaTime);
+        scrollYDelta = getScrollDelta(autoscrollPolicy, distanceY, timeStart, deltaTime);
+    }
 
     // If there is a nonzero delta, scroll in that direction
     if (std::abs(scrollXDelta) > 0.0f) ImGui::SetScrollX(ImGui::GetScrollX() + scrollXDelta);
     if (std::abs(scrollYDelta) > 0.0f) ImGui::SetScrollY(ImGui::GetScrollY() + scrollYDelta);
 }
 
-void TextSelect::drawSelection(const ImVec2& cursorPosStart) const {
+void TextSelect::addSelectionRect(const ImVec2& min, const ImVec2& max, bool isFullLine) const {
+    // Empty rectangles aren't visible
+    if (min.x >= max.x || min.y >= max.y) return;
+
+    // Merge the rectangle into the previous one if it continues it, either exactly or as a full line when merging
+    // middle lines
+    if (!selectionRects.empty()) {
+        SelectionRect& last = selectionRects.back();
+        bool continues = last.max.y == min.y;
+        bool sameExtent = last.min.x == min.x && last.max.x == max.x && last.isFullLine == isFullLine;
+
+        if (continues && (sameExtent || (mergeMiddleLines && last.isFullLine && isFullLine))) {
+            last.min.x = std::min(last.min.x, min.x);
+            last.max.x = std::max(last.max.x, max.x);
+            last.max.y = max.y;
+            return;
+        }
+    }
+
+    selectionRects.push_back({ min, max, isFullLine });
+}
+
+void TextSelect::emitSelectionRects(ImU32 color) const {
+    if ((color & IM_COL32_A_MASK) == 0 || selectionRects.empty()) return;
+
+    // Reserve space for all rectangles at once, in batches small enough for 16-bit indices
+    constexpr std::size_t maxBatchSize = 8192;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (std::size_t i = 0; i < selectionRects.size(); i += maxBatchSize) {
+        std::size_t batchSize = std::min(maxBatchSize, selectionRects.size() - i);
+        drawList->PrimReserve(static_cast<int>(batchSize * 6), static_cast<int>(batchSize * 4));
+
+        for (std::size_t j = i; j < i + batchSize; j++)
+            drawList->PrimRect(selectionRects[j].min, selectionRects[j].max, color);
+    }
+}
+
+void TextSelect::addLineSelectionRects(const ImVec2& cursorPosStart, std::size_t lineIdx, std::string_view line,
+    std::size_t startX, std::size_t endX) const {
+    if (wrapWidth > 0) {
+        drawWrappedSelection(cursorPosStart, lineIdx, line, startX, endX);
+        return;
+    }
+
+    // Ranges continuing to the next line extend past the end of the line to cover the newline
+    float minX = startX == 0 ? 0 : getCharPosX(lineIdx, line, startX);
+    float maxX = getCharPosX(lineIdx, line, endX);
+    if (endX == std::string_view::npos) maxX += frameMetrics.newlineWidth;
+
+    ImVec2 rectMin = cursorPosStart + ImVec2{ minX, getLineY(lineIdx) };
+    ImVec2 rectMax = cursorPosStart + ImVec2{ maxX, getLineY(lineIdx + 1) };
+    addSelectionRect(rectMin, rectMax, startX == 0 && endX == std::string_view::npos);
+}
+
+void TextSelect::drawHighlights(const ImVec2& cursorPosStart, std::size_t numLines) const {
+    if (highlights.empty() || numLines == 0) return;
+
+    // Sort the highlights added since the last frame, highlights at the same position stay in the order they were added
+    if (highlightsDirty) {
+        std::stable_sort(highlights.begin(), highlights.end(), [](const Highlight& a, const Highlight& b) {
+            return selectionKey(a.selection) < selectionKey(b.selection);
+        });
+        buildEndYTree(highlights, highlightEndYTree);
+        highlightsDirty = false;
+    }
+
+    // Only the highlights in lines inside the window's visible area are drawn
+    auto [firstVisible, lastVisible] = getVisibleLines(cursorPosStart, numLines);
+    visibleHighlights.clear();
+    forEachInLines(highlights, highlightEndYTree, firstVisible, lastVisible,
+        [this](const Highlight& highlight) { visibleHighlights.push_back(&highlight); });
+    if (visibleHighlights.empty()) return;
+
+    // Highlights are drawn in position order so overlapping ones stack the same way in every frame, rectangles are
+    // batched over runs of highlights with the same color
+    std::span<const std::string_view> lines = lineSource.lines(firstVisible, lastVisible - firstVisible + 1);
+    for (auto it = visibleHighlights.begin(); it != visibleHighlights.end();) {
+        ImU32 color = (*it)->color;
+        selectionRects.clear();
+
+        for (; it != visibleHighlights.end() && (*it)->color == color; ++it) {
+            auto [startX, startY, endX, endY] = (*it)->selection;
+            std::size_t firstLine = std::max(startY, firstVisible);
+            std::size_t lastLine = std::min(endY, lastVisible);
+
+            for (std::size_t i = firstLine; i <= lastLine; i++) {
+                std::size_t spanStartX = i == startY ? startX : 0;
+                std::size_t spanEndX = i == endY ? endX : std::string_view::npos;
+                addLineSelectionRects(cursorPosStart, i, lines[i - firstVisible], spanStartX, spanEndX);
+            }
+        }
+
+        emitSelectionRects(color == 0 ? frameMetrics.highlightColor : color);
+    }
+}
+
+void TextSelect::drawMatches(const ImVec2& cursorPosStart, std::size_t numLines) const {
+    if (!highlightMatches || findMatches.empty() || numLines == 0) return;
+
+    // Only draw the matches in lines inside the window's visible area
+    auto [firstVisible, lastVisible] = getVisibleLines(cursorPosStart, numLines);
+    auto it = std::lower_bound(findMatches.begin(), findMatches.end(), firstVisible,
+        [](const FindMatch& match, std::size_t line) { return match.line < line; });
+    if (it == findMatches.end() || it->line > lastVisible) return;
+
+    std::span<const std::string_view> lines = lineSource.lines(it->line, lastVisible - it->line + 1);
+    std::size_t firstLine = it->line;
+
+    selectionRects.clear();
+    for (; it != findMatches.end() && it->line <= lastVisible; ++it) {
+        addLineSelectionRects(cursorPosStart, it->line, lines[it->line - firstLine], it->start, it->end);
+    }
+
+    // The selection is drawn over the matches
+    emitSelectionRects(frameMetrics.highlightColor);
+}
+
+void TextSelect::drawWrappedSelection(const ImVec2& cursorPosStart, std::size_t lineIdx, std::string_view line,
+    std::size_t startX, std::size_t endX) const {
+    const float newlineWidth = frameMetrics.newlineWidth;
+    const float rowHeight = frameMetrics.rowHeight;
+    const float lineY = getLineY(lineIdx);
+    const float nextLineY = getLineY(lineIdx + 1);
+
+    float rowY = lineY;
+    forEachWrapRow(line, wrapWidth, [&](std::size_t rowStart, std::size_t rowEnd) {
+        // Rows after the end of the selection don't need to be checked
+        if (endX != std::string_view::npos && endX <= rowStart && rowStart > 0) return false;
+
+        bool isLastRow = rowEnd >= line.size();
+        float nextRowY = isLastRow ? nextLineY : rowY + rowHeight;
+
+        // Rows before the start of the selection are skipped
+        if (startX < rowEnd || isLastRow) {
+            // The selection on the last row of a line extends past the end if it continues to the next line
+            float minX = getCharPosX(lineIdx, line, std::max(startX, rowStart), rowStart);
+            float maxX = getCharPosX(lineIdx, line, std::min(endX, rowEnd), rowStart);
+            if (isLastRow && endX == std::string_view::npos) maxX += newlineWidth;
+
+            ImVec2 rectMin = cursorPosStart + ImVec2{ minX, rowY };
+            ImVec2 rectMax = cursorPosStart + ImVec2{ maxX, nextRowY };
+            bool isFullRow = startX <= rowStart && (isLastRow ? endX == std::string_view::npos : endX >= rowEnd);
+            addSelectionRect(rectMin, rectMax, isFullRow);
+        }
+
+        rowY = nextRowY;
+        return true;
+    });
+}
+
+void TextSelect::drawSelection(const ImVec2& cursorPosStart, std::size_t numLines) const {
+    TEXTSELECT_ZONE("TextSelect::drawSelection");
+    TEXTSELECT_TIME(drawTime);
     if (!hasSelection()) return;
 
     // Start and end positions
     auto [startX, startY, endX, endY] = getSelection();
 
-    std::size_t numLines = getNumLines();
     if (startY >= numLines || endY >= numLines) return;
 
-    // Add a rectangle to the draw list for each line contained in the selection
-    for (std::size_t i = startY; i <= endY; i++) {
-        std::string_view line = getLineAtIdx(i);
+    // Only draw the lines that are inside the window's visible area
+    auto [firstVisible, lastVisible] = getVisibleLines(cursorPosStart, numLines);
+    if (lastVisible < startY || firstVisible > endY) return;
 
-        // Display sizes
-        // The width of the space character is used for the width of newlines.
-        const float newlineWidth = ImGui::CalcTextSize(" ").x;
-        const float textHeight = ImGui::GetTextLineHeightWithSpacing();
+    // Fetch all visible lines contained in the selection at once
+    std::size_t firstLine = std::max(startY, firstVisible);
+    std::size_t lastLine = std::min(endY, lastVisible);
+    std::span<const std::string_view> lines = lineSource.lines(firstLine, lastLine - firstLine + 1);
+    TEXTSELECT_COUNT(linesDrawn, lines.size());
 
+    selectionSpansBuffer.clear();
+    selectionRects.clear();
+
+    // Add a rectangle to the batch for each visible line contained in the selection
+    for (std::size_t i = firstLine; i <= lastLine; i++) {
+        std::string_view line = lines[i - firstLine];
+
+        // Selected character range on this line
         // The first and last rectangles should only extend to the selection boundaries
         // The middle rectangles (if any) enclose the entire line + some extra width for the newline.
-        float minX = i == startY ? substringSizeX(line, 0, startX) : 0;
-        float maxX = i == endY ? substringSizeX(line, 0, endX) : substringSizeX(line, 0) + newlineWidth;
+        std::size_t spanStartX = i == startY ? startX : 0;
+        std::size_t spanEndX = i == endY ? endX : std::string_view::npos;
+
+        if (blockSelection) {
+            // Block selections cover the same columns on every line
+            auto [columnStart, columnEnd] = getBlockColumns(i, line);
+            ImVec2 rectMin = cursorPosStart + ImVec2{ getCharPosX(i, line, columnStart), getLineY(i) };
+            ImVec2 rectMax = cursorPosStart + ImVec2{ getCharPosX(i, line, columnEnd), getLineY(i + 1) };
+            addSelectionRect(rectMin, rectMax, false);
+            continue;
+        }
+
+        if (wrapWidth > 0) {
+            drawWrappedSelection(cursorPosStart, i, line, spanStartX, spanEndX);
+            continue;
+        }
+
+        // Reuse the span measured in the last frame if possible
+        const SelectionSpan* lastSpan = nullptr;
+        if (i >= selectionSpansFirst && i - selectionSpansFirst < selectionSpans.size())
+            lastSpan = &selectionSpans[i - selectionSpansFirst];
+
+        SelectionSpan& span = selectionSpansBuffer.emplace_back();
+        if (lastSpan && lastSpan->lineData == line.data() && lastSpan->lineSize == line.size()
+            && lastSpan->startX == spanStartX && lastSpan->endX == spanEndX) {
+            span = *lastSpan;
+        } else {
+            const float newlineWidth = frameMetrics.newlineWidth;
+            float minX = spanStartX == 0 ? 0 : getCharPosX(i, line, spanStartX);
+            float maxX = spanEndX == std::string_view::npos ? getCharPosX(i, line, spanEndX) + newlineWidth
+                                                            : getCharPosX(i, line, spanEndX);
+            span = { line.data(), line.size(), spanStartX, spanEndX, minX, maxX };
+        }
 
         // Rectangle height equals text height
-        float minY = static_cast<float>(i) * textHeight;
-        float maxY = static_cast<float>(i + 1) * textHeight;
+        float minY = getLineY(i);
+        float maxY = getLineY(i + 1);
 
         // Get rectangle corner points offset from the cursor's start position in the window
-        ImVec2 rectMin = cursorPosStart + ImVec2{ minX, minY };
-        ImVec2 rectMax = cursorPosStart + ImVec2{ maxX, maxY };
+        ImVec2 rectMin = cursorPosStart + ImVec2{ span.minX, minY };
+        ImVec2 rectMax = cursorPosStart + ImVec2{ span.maxX, maxY };
+
+        addSelectionRect(rectMin, rectMax, spanStartX == 0 && spanEndX == std::string_view::npos);
+    }
+
+    // Draw all rectangles at once
+    emitSelectionRects(frameMetrics.selectionColor);
+
+    // Keep this frame's spans for the next frame
+    std::swap(selectionSpans, selectionSpansBuffer);
+    selectionSpansFirst = firstLine;
+}
+
+template <class F, class G>
+bool TextSelect::forEachChunk(const LineSource& source, const Selection& selection, F&& callback, G&& onFetch) {
+    auto [startX, startY, endX, endY] = selection;
+    if (endY >= source.numLines()) return false;
+
+    std::span<const std::string_view> lines;
+    for (std::size_t i = startY; i <= endY; i++) {
+        // Fetch lines from the source in chunks
+        std::size_t chunkIdx = (i - startY) % lineFetchSize;
+        if (chunkIdx == 0) {
+            std::size_t count = std::min(lineFetchSize, endY - i + 1);
+            if (!onFetch(count)) return false;
+            lines = source.lines(i, count);
+        }
 
-        // Draw the rectangle
-        ImU32 color = ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
-        ImGui::GetWindowDrawList()->AddRectFilled(rectMin, rectMax, color);
+        // Similar logic to drawing selections
+        std::string_view line = lines[chunkIdx];
+        std::size_t subStart = std::min(i == startY ? startX : 0, line.size());
+        std::size_t subEnd = i == endY ? std::max(endX, subStart) : line.size();
+
+        std::string_view lineToAdd = line.substr(subStart, subEnd - subStart);
+        callback(lineToAdd);
+
+        // If lines before the last line don't already end with newlines, add them in
+        if (!lineToAdd.ends_with('\n') && i < endY) callback("\n");
     }
+
+    return true;
+}
+
+void TextSelect::drawText(const ImVec2& cursorPosStart, std::size_t numLines) const {
+    TEXTSELECT_ZONE("TextSelect::drawText");
+
+    if (numLines > 0) {
+        // Only draw the lines that are inside the window's visible area, like the selection
+        auto [firstVisible, lastVisible] = getVisibleLines(cursorPosStart, numLines);
+        std::span<const std::string_view> lines = lineSource.lines(firstVisible, lastVisible - firstVisible + 1);
+
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        ImFont* font = ImGui::GetFont();
+        const float fontSize = ImGui::GetFontSize();
+        for (std::size_t i = firstVisible; i <= lastVisible; i++) {
+            std::string_view line = lines[i - firstVisible];
+            ImVec2 pos = cursorPosStart + ImVec2{ 0, getLineY(i) };
+            drawList->AddText(font, fontSize, pos, frameMetrics.textColor, line.data(), line.data() + line.size(),
+                std::max(wrapWidth, 0.0f));
+
+            if (wrapWidth <= 0) textWidth = std::max(textWidth, getCharPosX(i, line, line.size()));
+        }
+    }
+
+    // Reserve the space of all lines with one item
+    ImGui::Dummy({ wrapWidth > 0 ? wrapWidth : textWidth, getContentHeight(numLines) });
+}
+
+template <class F>
+void TextSelect::forEachBlockChunk(F&& callback) const {
+    auto [startX, startY, endX, endY] = getSelection();
+    if (endY >= lineSource.numLines()) return;
+
+    // Only the selected columns of each line are passed on, the rest of the line is not read
+    for (std::size_t first = startY; first <= endY; first += lineFetchSize) {
+        std::size_t count = std::min(lineFetchSize, endY - first + 1);
+        std::span<const std::string_view> lines = lineSource.lines(first, count);
+
+        for (std::size_t i = 0; i < count; i++) {
+            auto [columnStart, columnEnd] = getBlockColumns(first + i, lines[i]);
+            std::string_view columns = lines[i].substr(columnStart, columnEnd - columnStart);
+            callback(columns);
+
+            if (!columns.ends_with('\n') && first + i < endY) callback("\n");
+        }
+    }
+}
+
+template <class F>
+void TextSelect::walkSelectedChunks(F&& callback) const {
+    if (!hasSelection()) return;
+
+    if (blockSelection) {
+        forEachBlockChunk(callback);
+        return;
+    }
+
+    forEachChunk(lineSource, getSelection(), callback, [](std::size_t) { return true; });
+}
+
+void TextSelect::forEachSelectedChunk(const std::function<void(std::string_view)>& callback) const {
+    walkSelectedChunks(callback);
+}
+
+std::size_t TextSelect::getSelectedTextSize() const {
+    std::size_t size = 0;
+    walkSelectedChunks([&size](std::string_view chunk) { size += chunk.size(); });
+    return size;
+}
+
+std::size_t TextSelect::copyTo(std::span<char> buffer) const {
+    std::size_t written = 0;
+    walkSelectedChunks([buffer, &written](std::string_view chunk) {
+        // Copy as much of the chunk as can fit in the remaining space
+        std::size_t count = std::min(chunk.size(), buffer.size() - written);
+        std::copy_n(chunk.data(), count, buffer.data() + written);
+        written += count;
+    });
+    return written;
 }
 
 void TextSelect::copy() const {
+    TEXTSELECT_ZONE("TextSelect::copy");
+#ifdef TEXTSELECT_STATS
+    stats.copyTime = 0.0;
+#endif
+    TEXTSELECT_TIME(copyTime);
     if (!hasSelection()) return;
 
-    auto [startX, startY, endX, endY] = getSelection();
+    if (blockSelection) {
+        // Measuring the columns twice would cost more than growing the string, so block selections are collected in
+        // a single pass
+        std::pmr::string selectedText{ memoryResource };
+        forEachBlockChunk([&selectedText](std::string_view chunk) { selectedText += chunk; });
+        ImGui::SetClipboardText(selectedText.c_str());
+        return;
+    }
 
-    // Collect selected text in a single string
-    std::string selectedText;
+    // Measure the selected text first so it can be collected with a single allocation
+    // The buffer has an extra byte for the null terminator required by ImGui::SetClipboardText.
+    std::size_t size = getSelectedTextSize();
+    auto selectedText = static_cast<char*>(memoryResource->allocate(size + 1, alignof(char)));
 
-    for (std::size_t i = startY; i <= endY; i++) {
-        // Similar logic to drawing selections
-        std::size_t subStart = i == startY ? startX : 0;
-        std::string_view line = getLineAtIdx(i);
+    std::size_t written = copyTo({ selectedText, size });
+    selectedText[written] = '\0';
 
-        auto stringStart = line.begin();
-        utf8::unchecked::advance(stringStart, subStart);
+    ImGui::SetClipboardText(selectedText);
+    memoryResource->deallocate(selectedText, size + 1, alignof(char));
+}
 
-        auto stringEnd = stringStart;
-        if (i == endY) utf8::unchecked::advance(stringEnd, endX - subStart);
-        else stringEnd = line.end();
+void TextSelect::runAsyncCopy(std::stop_token stopToken, AsyncCopy& state, LineSource source, Selection selection) {
+    auto onFetch = [&](std::size_t count) {
+        state.linesDone += count;
+        return !stopToken.stop_requested();
+    };
 
-        std::string_view lineToAdd = line.substr(stringStart - line.begin(), stringEnd - stringStart);
-        selectedText += lineToAdd;
+    // Same as copy(), the text is measured first and collected with a single allocation
+    std::size_t size = 0;
+    if (forEachChunk(source, selection, [&size](std::string_view chunk) { size += chunk.size(); }, onFetch)) {
+        try {
+            auto text = std::make_unique_for_overwrite<char[]>(size + 1);
+
+            std::size_t written = 0;
+            bool copied = forEachChunk(source, selection, [&](std::string_view chunk) {
+                std::size_t count = std::min(chunk.size(), size - written);
+                std::copy_n(chunk.data(), count, text.get() + written);
+                written += count;
+            }, onFetch);
+
+            text[written] = '\0';
+            if (copied) state.text = std::move(text);
+        } catch (const std::bad_alloc&) {
+            // Nothing is copied if the text does not fit in memory
+        }
+    }
 
-        // If lines before the last line don't already end with newlines, add them in
-        if (!lineToAdd.ends_with('\n') && i < endY) selectedText += '\n';
+    state.done.store(true, std::memory_order_release);
+}
+
+void TextSelect::copyAsync() {
+    cancelCopy();
+    if (!hasSelection()) return;
+
+    // Columns of block selections are measured with the font, which can't be used from the worker thread
+    if (blockSelection) {
+        copy();
+        return;
     }
 
-    ImGui::SetClipboardText(selectedText.c_str());
+    // The worker gets a snapshot of the selection and line source, so they can change while it runs
+    Selection selection = getSelection();
+    asyncCopy = std::make_unique<AsyncCopy>();
+    asyncCopy->totalLines = 2 * (selection.endY - selection.startY + 1);
+
+    // Vectors can reallocate when lines are added, so the worker reads its own copy of the selected lines
+    LineSource source = lineSource;
+    // Nothing is copied if the selection is past the end of the text, the copy is left empty in that case
+    if (lineSource.vector) {
+        if (selection.endY < lineSource.vector->size()) {
+            auto first = lineSource.vector->begin() + static_cast<std::ptrdiff_t>(selection.startY);
+            asyncCopy->lines.assign(first, first + static_cast<std::ptrdiff_t>(selection.endY - selection.startY + 1));
+        }
+        source.vector = &asyncCopy->lines;
+        selection.endY -= selection.startY;
+        selection.startY = 0;
+    }
+
+    asyncCopy->thread = std::jthread{ runAsyncCopy, std::ref(*asyncCopy), source, selection };
+}
+
+float TextSelect::getCopyProgress() const {
+    if (!asyncCopy) return 0.0f;
+
+    std::size_t linesDone = std::min(asyncCopy->linesDone.load(), asyncCopy->totalLines);
+    return static_cast<float>(linesDone) / static_cast<float>(asyncCopy->totalLines);
+}
+
+void TextSelect::setAsyncCopyEnabled(bool enabled) {
+    asyncCopyEnabled = enabled;
+}
+
+void TextSelect::setPrecomputeThreads(std::size_t threads) {
+    if (threads == precomputeThreads) return;
+
+    // The precomputation in progress is restarted with the new number of threads
+    cancelPrecompute();
+    precomputeThreads = threads;
+}
+
+float TextSelect::getPrecomputeProgress() const {
+    if (!geometryJob) return 0.0f;
+
+    std::size_t linesDone = std::min(lineOffsetsY.size() - 1 - geometryJob->firstLine, geometryJob->numLines);
+    return static_cast<float>(linesDone) / static_cast<float>(geometryJob->numLines);
 }
 
 void TextSelect::selectAll() {
-    std::size_t lastLineIdx = getNumLines() - 1;
-    std::string_view lastLine = getLineAtIdx(lastLineIdx);
+    std::size_t numLines = lineSource.numLines();
+    if (numLines == 0) return;
+
+    std::size_t lastLineIdx = numLines - 1;
+    std::string_view lastLine = lineSource.line(lastLineIdx);
 
     // Set the selection range from the beginning to the end of the last line
+    blockSelection = false;
     selectStart = { 0, 0 };
-    selectEnd = { utf8Length(lastLine), lastLineIdx };
+    selectEnd = { lastLine.size(), lastLineIdx };
+}
+
+void TextSelect::setWidthCacheEnabled(bool enabled) {
+    widthCacheEnabled = enabled;
+    if (!enabled) widthCache.clear();
+}
+
+std::size_t TextSelect::byteToCharIndex(std::string_view line, std::size_t byteIdx) {
+    return utf8Length(line.substr(0, std::min(byteIdx, line.size())));
+}
+
+std::size_t TextSelect::charToByteIndex(std::string_view line, std::size_t charIdx) {
+    return utf8Offset(line, charIdx);
+}
+
+void TextSelect::setConfig(const Config& newConfig) {
+    config = newConfig;
+}
+
+void TextSelect::setAutoscrollPolicy(const AutoscrollPolicy& policy) {
+    autoscrollPolicy = policy;
+}
+
+void TextSelect::setMergeMiddleLines(bool enabled) {
+    mergeMiddleLines = enabled;
+}
+
+void TextSelect::setMetricsCache(MetricsCache* cache) {
+    metricsCache = cache;
+}
+
+void TextSelect::setMonospaceMode(MonospaceMode mode) {
+    if (mode == monospaceMode) return;
+
+    // Measurements are redone with the new mode in the next update
+    monospaceMode = mode;
+    cacheFont = nullptr;
+}
+
+void TextSelect::setEncoding(Encoding newEncoding) {
+    encoding = newEncoding;
+}
+
+void TextSelect::setWrapWidth(float width) {
+    // The line geometry only needs to be rebuilt if the wrap width changed
+    width = std::max(width, 0.0f);
+    if (width == wrapWidth) return;
+
+    wrapWidth = width;
+    lineOffsetsY = { 0.0 };
+    lineOffsetsBaseY = 0.0;
+    cancelPrecompute();
+
+    // Columns don't line up in wrapped lines, block selections become regular selections between the same positions
+    if (wrapWidth > 0) blockSelection = false;
 }
 
+void TextSelect::restartFind() {
+    findMatches.clear();
+    findScannedLines = 0;
+    findComplete = findPattern.empty();
+}
+
+void TextSelect::setFindPattern(std::string_view pattern) {
+    if (pattern == findPattern) return;
+
+    findPattern = pattern;
+    if (pattern.empty()) findRequest = FindRequest::None;
+    restartFind();
+}
+
+void TextSelect::continueFind(std::size_t numLines) {
+    if (findPattern.empty()) return;
+
+    // Search the next lines, up to the budget
+    findScannedLines = std::min(findScannedLines, numLines);
+    std::size_t endLine = findScannedLines + std::min(findLineBudget, numLines - findScannedLines);
+    for (std::size_t i = findScannedLines; i < endLine; i += lineFetchSize) {
+        std::span<const std::string_view> lines = lineSource.lines(i, std::min(lineFetchSize, endLine - i));
+
+        for (std::size_t j = 0; j < lines.size(); j++) {
+            std::string_view line = lines[j];
+            for (std::size_t pos = findSubstring(line, findPattern, 0); pos != std::string_view::npos;
+                 pos = findSubstring(line, findPattern, pos + findPattern.size()))
+                findMatches.push_back({ i + j, pos, pos + findPattern.size() });
+        }
+    }
+
+    findScannedLines = endLine;
+    findComplete = endLine == numLines;
+}
+
+void TextSelect::resolveFindRequest(const ImVec2& cursorPosStart) {
+    if (findRequest == FindRequest::None) return;
+
+    // Matches are ordered and don't overlap, so both their starts and ends are sorted
+    const FindMatch* match = nullptr;
+    bool selected = hasSelection();
+    auto [startX, startY, endX, endY] = selected ? getSelection() : Selection{ 0, 0, 0, 0 };
+
+    if (findRequest == FindRequest::Next) {
+        // First match starting at or after the end of the selection, it is known as soon as any such match is found
+        auto before = [](const FindMatch& m, const CursorPos& pos) {
+            return m.line < pos.y || (m.line == pos.y && m.start < pos.x);
+        };
+        auto it = std::lower_bound(findMatches.begin(), findMatches.end(), CursorPos{ endX, endY }, before);
+
+        if (it != findMatches.end()) match = &*it;
+        else if (!findComplete) return;
+        else if (!findMatches.empty()) match = &findMatches.front();
+    } else {
+        // Last match ending at or before the start of the selection, it is known once the selection's first line has
+        // been searched
+        auto after = [](const CursorPos& pos, const FindMatch& m) {
+            return pos.y < m.line || (pos.y == m.line && pos.x < m.end);
+        };
+        auto it = std::upper_bound(findMatches.begin(), findMatches.end(), CursorPos{ startX, startY }, after);
+
+        if (selected && it != findMatches.begin() && findScannedLines > startY) match = &*(it - 1);
+        else if (!findComplete) return;
+        else if (!findMatches.empty()) match = &findMatches.back();
+    }
+
+    findRequest = FindRequest::None;
+    if (match == nullptr) return;
+
+    selectStart = { match->start, match->line };
+    selectEnd = { match->end, match->line };
+
+    scrollIntoView(cursorPosStart, selectStart, selectEnd, true);
+}
+
+std::span<const TextSelect::FindMatch> TextSelect::findAll(std::string_view pattern) {
+    setFindPattern(pattern);
+    return findMatches;
+}
+
+void TextSelect::findNext(std::string_view pattern, bool backwards) {
+    setFindPattern(pattern);
+    if (!pattern.empty()) findRequest = backwards ? FindRequest::Previous : FindRequest::Next;
+}
+
+void TextSelect::setHighlightMatches(bool enabled) {
+    highlightMatches = enabled;
+}
+
+void TextSelect::setFindLineBudget(std::size_t lines) {
+    findLineBudget = std::max<std::size_t>(lines, 1);
+}
+
+void TextSelect::notifyLinesRemovedFront(std::size_t count) {
+    if (count == 0) return;
+
+    // A background copy or precomputation would read the wrong lines now
+    cancelCopy();
+    cancelPrecompute();
+
+    // Clear the selection if it was entirely in the removed lines
+    bool selectionRemoved = hasSelection() ? getSelection().endY < count
+                                           : !selectStart.isInvalid() && selectStart.y < count;
+    if (selectionRemoved) {
+        selectStart = {};
+        selectEnd = {};
+    } else {
+        // Keep the selection on the same text, positions in removed lines move to the start of the text
+        for (CursorPos* pos : { &selectStart, &selectEnd }) {
+            if (pos->isInvalid()) continue;
+
+            if (pos->y >= count) pos->y -= count;
+            else *pos = { 0, 0 };
+        }
+    }
+
+    // Anchors and highlights are kept on the same text like the selection
+    for (auto it = anchors.begin(); it != anchors.end();) {
+        if (removeFrontLines(it->second, count)) ++it;
+        else it = anchors.erase(it);
+    }
+    std::erase_if(highlights, [count](Highlight& highlight) { return !removeFrontLines(highlight.selection, count); });
+    anchorIndexDirty = true;
+    highlightsDirty = true;
+
+    // Drop cached widths of removed lines, the remaining entries are keyed by absolute line number
+    removedLines += count;
+    std::erase_if(widthCache, [this](const auto& entry) { return entry.first < removedLines; });
+    std::erase_if(lineHashes, [this](const auto& entry) { return entry.first < removedLines; });
+    scratchLineIdx = std::string_view::npos;
+
+    // Drop removed lines from the line geometry index
+    // The remaining positions are kept as they are and offset by the position of the new first line.
+    if (count < lineOffsetsY.size()) {
+        lineOffsetsY.erase(lineOffsetsY.begin(), lineOffsetsY.begin() + static_cast<std::ptrdiff_t>(count));
+        lineOffsetsBaseY = lineOffsetsY.front();
+    } else {
+        lineOffsetsY = { 0.0 };
+        lineOffsetsBaseY = 0.0;
+    }
+
+    // Selection spans of lines that are still present can be reused
+    if (count <= selectionSpansFirst) {
+        selectionSpansFirst -= count;
+    } else {
+        std::size_t removedSpans = std::min(count - selectionSpansFirst, selectionSpans.size());
+        auto removedEnd = selectionSpans.begin() + static_cast<std::ptrdiff_t>(removedSpans);
+        selectionSpans.erase(selectionSpans.begin(), removedEnd);
+        selectionSpansFirst = 0;
+    }
+
+    // Drop find matches in removed lines, searched lines stay searched
+    std::erase_if(findMatches, [count](const FindMatch& match) { return match.line < count; });
+    for (FindMatch& match : findMatches) match.line -= count;
+    findScannedLines -= std::min(findScannedLines, count);
+
+    // The text under the mouse cursor changed
+    lastMousePos = { -1.0f, -1.0f };
+}
+
+#ifdef TEXTSELECT_STATS
+void TextSelect::showStatsWindow(const char* title, bool* open) const {
+    if (ImGui::Begin(title, open)) {
+        ImGui::Text("Update: %.3f ms", stats.updateTime);
+        ImGui::Text("Mouse handling: %.3f ms", stats.mouseTime);
+        ImGui::Text("Selection drawing: %.3f ms", stats.drawTime);
+        ImGui::Text("Last copy: %.3f ms", stats.copyTime);
+        ImGui::Separator();
+        ImGui::Text("Lines drawn: %zu", stats.linesDrawn);
+        ImGui::Text("CalcTextSize calls: %zu", stats.calcTextSizeCalls);
+        ImGui::Text("Bytes measured: %zu", stats.bytesMeasured);
+        ImGui::Text("Cache hits: %zu", stats.cacheHits);
+        ImGui::Text("Cache misses: %zu", stats.cacheMisses);
+    }
+    ImGui::End();
+}
+#endif
+
 void TextSelect::update() {
+    updateFrame(false);
+}
+
+void TextSelect::render() {
+    updateFrame(true);
+}
+
+void TextSelect::updateFrame(bool renderText) {
+    TEXTSELECT_ZONE("TextSelect::update");
+#ifdef TEXTSELECT_STATS
+    stats = { .copyTime = stats.copyTime };
+#endif
+    TEXTSELECT_TIME(updateTime);
     // ImGui::GetCursorStartPos() is in window coordinates so it is added to the window position
     ImVec2 cursorPosStart = ImGui::GetWindowPos() + ImGui::GetCursorStartPos();
 
@@ -282,15 +2229,50 @@ void TextSelect::update() {
     bool hovered = ImGui::IsWindowHovered();
     if (hovered) ImGui::SetMouseCursor(ImGuiMouseCursor_TextInput);
 
+    // The number of lines is only queried once per frame
+    std::size_t numLines = lineSource.numLines();
+    resolveConfig();
+    validateCaches();
+    scratchLineIdx = std::string_view::npos;
+
+    // Precompute the geometry of wrapped lines in the background, and add the lines finished since the last frame
+    startPrecompute(numLines);
+    mergePrecomputedLines();
+
+    if (renderText) drawText(cursorPosStart, numLines);
+
     // Handle mouse events
+    // Autoscroll acceleration only builds up while the mouse is held outside of the window
+    if (!ImGui::IsMouseDown(ImGuiMouseButton_Left) || hovered) {
+        autoscrollTime = 0.0f;
+        autoscrollPages = 0.0f;
+    }
+
     if (ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
-        if (hovered) handleMouseDown(cursorPosStart);
+        if (hovered) handleMouseDown(cursorPosStart, numLines);
         else handleScrolling();
+    } else if (ImGui::IsWindowFocused()) {
+        handleKeyboard(cursorPosStart, numLines);
     }
 
-    drawSelection(cursorPosStart);
+    // Search for the find pattern, then select the requested match if it has been found
+    continueFind(numLines);
+    resolveFindRequest(cursorPosStart);
+
+    drawHighlights(cursorPosStart, numLines);
+    drawMatches(cursorPosStart, numLines);
+    drawSelection(cursorPosStart, numLines);
+
+    // Put the text of a finished background copy on the clipboard
+    if (asyncCopy && asyncCopy->done.load(std::memory_order_acquire)) {
+        if (asyncCopy->text) ImGui::SetClipboardText(asyncCopy->text.get());
+        asyncCopy.reset();
+    }
 
     // Keyboard shortcuts
     if (ImGui::Shortcut(ImGuiMod_Ctrl | ImGuiKey_A)) selectAll();
-    else if (ImGui::Shortcut(ImGuiMod_Ctrl | ImGuiKey_C)) copy();
+    else if (ImGui::Shortcut(ImGuiMod_Ctrl | ImGuiKey_C)) {
+        if (asyncCopyEnabled) copyAsync();
+        else copy();
+    }
 }
@@ -3,19 +3,136 @@
 
 #pragma once
 
+// Optional configuration header, included before anything else
+// It can define TEXTSELECT_STATS to collect per-frame statistics, and TEXTSELECT_ZONE(name) to mark the hot paths
+// for a profiler (e.g. with Tracy's ZoneScopedN). It must be the same for all files including this header.
+#ifdef TEXTSELECT_USER_CONFIG
+#include TEXTSELECT_USER_CONFIG
+#endif
+
+#include <array>
+#include <atomic>
+#include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <stop_token>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include <imgui.h>
 
+// A source of text lines that can provide a range of lines in a single call.
+// numLines(): Returns the total number of lines
+// lines(first, count): Returns a contiguous span of `count` lines starting at line number `first`. The span only needs
+//                      to stay valid until the next call to lines().
+// Sources can also declare the encoding of their text with a `static constexpr TextSelect::Encoding encoding` member.
+template <class T>
+concept TextSelectSource = requires(T& source, std::size_t first, std::size_t count) {
+    { source.numLines() } -> std::convertible_to<std::size_t>;
+    { source.lines(first, count) } -> std::convertible_to<std::span<const std::string_view>>;
+};
+
 // Manages text selection in a GUI window.
-// This class only works if the window only has text, and line wrapping is not supported.
+// This class only works if the window only has text. Line wrapping is supported if enabled with setWrapWidth().
 // The window should also have the "NoMove" flag set so mouse drags can be used to select text.
 class TextSelect {
-    // Cursor position in the window.
+public:
+    // How the monospace fast path is used for measuring text.
+    // In monospace mode, positions in lines are calculated from the width of a character instead of measuring text.
+    // Characters with other widths are measured individually, so results are always correct even if the font is not
+    // actually monospace (but there is no speedup in that case).
+    enum class MonospaceMode {
+        Auto, // Use the fast path if all printable ASCII characters in the current font have the same width
+        On, // Always use the fast path
+        Off // Never use the fast path
+    };
+
+    // Encoding of the text.
+    // Dear ImGui displays UTF-8 text, so this only declares a guarantee about the text. ASCII text (with all bytes
+    // below 0x80) has a character in each byte, so it is handled with byte offsets without decoding characters.
+    enum class Encoding {
+        UTF8,
+        ASCII
+    };
+
+    class MetricsCache;
+
+#ifdef TEXTSELECT_STATS
+    // Statistics of the work done by update() in the last frame
+    struct Stats {
+        std::size_t linesDrawn = 0; // Lines visited when drawing the selection
+        std::size_t calcTextSizeCalls = 0; // Text measured by Dear ImGui
+        std::size_t bytesMeasured = 0; // UTF-8 bytes walked when measuring and wrapping text
+        std::size_t cacheHits = 0; // Line measurements reused from a cache
+        std::size_t cacheMisses = 0; // Lines measured
+        double updateTime = 0.0; // Times in milliseconds
+        double mouseTime = 0.0;
+        double drawTime = 0.0;
+        double copyTime = 0.0; // Time of the last copy, kept between frames
+    };
+#endif
+
+    // Class of a character for word selection, a word is a sequence of characters of the same class.
+    enum class CharClass : std::uint8_t {
+        Word, // Letters, digits, marks, and underscores
+        Space, // Whitespace and control characters
+        Punctuation, // Punctuation and symbols
+        Ideograph // CJK ideographs and kana, which are not separated by spaces
+    };
+
+    // Configuration of a TextSelect instance.
+    // Metrics and colors left at their defaults are taken from the current Dear ImGui font and style in every frame.
+    // Apps that display text with custom metrics can set them here, they must match how the text is displayed.
+    struct Config {
+        float newlineWidth = -1.0f; // Width of the selection past the end of lines, the width of a space if negative
+        float rowHeight = -1.0f; // Height of a line of text, ImGui::GetTextLineHeight() if negative
+        float lineSpacing = -1.0f; // Vertical space between lines, the style's item spacing if negative
+        ImU32 selectionColor = 0; // Color of the selection, ImGuiCol_TextSelectedBg if 0
+        ImU32 highlightColor = 0; // Color of highlighted find matches, the selection color at half alpha if 0
+        ImU32 textColor = 0; // Color of text drawn by render(), ImGuiCol_Text if 0
+
+        // Gets the class of a character for double-click and keyboard word selection, getCharClass() if empty
+        // For example, a classifier treating '/', '.', and ':' as word characters selects whole paths and C++ names.
+        std::function<CharClass(char32_t)> classifier;
+
+        bool doubleClickSelectsWord = true; // If double-clicking selects a word
+        bool tripleClickSelectsLine = true; // If triple-clicking selects a line
+        bool shiftClickExtends = true; // If shift-clicking extends the selection
+        bool altDragSelectsBlock = true; // If dragging with Alt held selects a block of columns
+    };
+
+    // Settings for scrolling the window while a selection is dragged outside of it.
+    // The scroll speed is proportional to the distance of the mouse cursor from the window, and increases the longer
+    // the cursor stays outside. Speeds are in pixels per second so scrolling is independent of the frame rate.
+    struct AutoscrollPolicy {
+        float speed = 10.0f; // Speed for each pixel of distance between the cursor and the window
+        float maxSpeed = 1000.0f; // Maximum speed from the distance, before acceleration
+        float acceleration = 1.0f; // Increase of the speed multiplier per second outside (the multiplier starts at 1)
+        float maxMultiplier = 20.0f; // Maximum speed multiplier from acceleration
+        float pagesPerSecond = 0.0f; // If positive, scroll by whole pages at this rate instead after pageJumpDelay
+        float pageJumpDelay = 2.0f; // Time in seconds the cursor has to stay outside before jumping by pages
+    };
+
+    // Match of a find pattern, given as a byte range [start, end) in a line.
+    struct FindMatch {
+        std::size_t line;
+        std::size_t start;
+        std::size_t end;
+    };
+
+    // Cursor position in the window, i.e. the position of a character in the text.
     struct CursorPos {
-        std::size_t x = std::string_view::npos; // X index of character
+        std::size_t x = std::string_view::npos; // X index of character (byte offset of the character in its line)
         std::size_t y = std::string_view::npos; // Y index of character
 
         // Checks if this position is invalid.
@@ -26,6 +143,8 @@ class TextSelect {
     };
 
     // Text selection in the window.
+    // X positions are byte offsets in their lines, so no UTF-8 decoding is needed to find the selected text. This is a
+    // plain value, so it can be stored and restored with getSelection() and setSelection().
     struct Selection {
         std::size_t startX;
         std::size_t startY;
@@ -33,47 +152,810 @@ class TextSelect {
         std::size_t endY;
     };
 
+    // Range of text highlighted under the selection (e.g. a search hit, an error span, or a diff hunk).
+    struct Highlight {
+        Selection selection;
+        ImU32 color = 0; // The highlight color from the config if 0
+    };
+
+    // Named selection stored in a TextSelect instance (e.g. a bookmark or an error span).
+    struct Anchor {
+        std::string_view name; // Valid until the anchor is removed
+        Selection selection; // Start and end are in order
+    };
+
+private:
+    // Memory resource for caches and scratch buffers, it must outlive this object
+    std::pmr::memory_resource* memoryResource;
+
     // Selection bounds
     // In a selection, the start and end positions may not be in order (the user can click and drag left/up which
     // reverses start and end).
     CursorPos selectStart;
     CursorPos selectEnd;
 
-    // Accessor functions to get line information
-    // This class only knows about line numbers so it must be provided with functions that give it text data.
-    std::function<std::string_view(std::size_t)> getLineAtIdx; // Gets the string given a line number
-    std::function<std::size_t()> getNumLines; // Gets the total number of lines
+    // Hash for looking up strings by string views
+    struct StringHash {
+        using is_transparent = void;
 
-    // Gets the user selection. Start and end are guaranteed to be in order.
-    Selection getSelection() const;
+        std::size_t operator()(std::string_view s) const {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
+    // Named anchors, and an index of them sorted by start position which is rebuilt when they change
+    // An interval tree over the index has the largest end line of the anchors in each subtree, so the anchors in a
+    // range of lines are found without visiting the anchors outside of it.
+    std::pmr::unordered_map<std::pmr::string, Selection, StringHash, std::equal_to<>> anchors{ memoryResource };
+    mutable std::pmr::vector<Anchor> anchorIndex{ memoryResource };
+    mutable std::pmr::vector<std::size_t> anchorEndYTree{ memoryResource };
+    mutable bool anchorIndexDirty = false;
+
+    // Highlights sorted by start position when they are drawn, with an interval tree over them like anchors
+    mutable std::pmr::vector<Highlight> highlights{ memoryResource };
+    mutable std::pmr::vector<std::size_t> highlightEndYTree{ memoryResource };
+    mutable bool highlightsDirty = false;
+    mutable std::pmr::vector<const Highlight*> visibleHighlights{ memoryResource }; // Scratch list, in drawing order
+
+    // Block (column) selection bounds, as x-positions relative to the start of the text
+    // A block selection spans the lines of selectStart and selectEnd, and the columns between these positions on each
+    // line.
+    bool blockSelection = false;
+    float blockStartX = 0.0f;
+    float blockEndX = 0.0f;
+
+    // Accessor to get line information
+    // This class only knows about line numbers so it must be provided with a source that gives it text data. Exactly
+    // one of the following is used: a vector of lines, a TextSelectSource object, or a pair of accessor functions.
+    struct LineSource {
+        // Vector of lines, accessed directly
+        const std::vector<std::string_view>* vector = nullptr;
+
+        // TextSelectSource object, accessed through type-erased functions
+        void* object = nullptr;
+        std::span<const std::string_view> (*objectLines)(void*, std::size_t, std::size_t) = nullptr;
+        std::size_t (*objectNumLines)(void*) = nullptr;
+
+        // Accessor functions, fetched lines are collected in a buffer so they can be returned as a span
+        // The functions are either function pointers with a user data pointer, or std::function objects.
+        std::string_view (*getLineAtIdxPtr)(std::size_t, void*) = nullptr;
+        std::size_t (*getNumLinesPtr)(void*) = nullptr;
+        void* userData = nullptr;
+        std::function<std::string_view(std::size_t)> getLineAtIdx; // Gets the string given a line number
+        std::function<std::size_t()> getNumLines; // Gets the total number of lines
+        mutable std::pmr::vector<std::string_view> buffer;
+
+        // Creates an empty line source, the buffer is allocated from a memory resource.
+        explicit LineSource(std::pmr::memory_resource* resource) : buffer{ resource } {}
+
+        // Gets a range of lines. The returned span is valid until the next call.
+        std::span<const std::string_view> lines(std::size_t first, std::size_t count) const;
+
+        // Gets a single line.
+        std::string_view line(std::size_t idx) const {
+            return lines(idx, 1)[0];
+        }
+
+        // Gets the total number of lines.
+        std::size_t numLines() const {
+            if (vector) return vector->size();
+            if (object) return objectNumLines(object);
+            if (getNumLinesPtr) return getNumLinesPtr(userData);
+            return getNumLines();
+        }
+    };
+
+    LineSource lineSource{ memoryResource };
+
+    // Measured positions of the characters in a line
+    // For proportional fonts, this has the x-position of each byte in the line (all bytes of a character have the
+    // position where the character starts), followed by the width of the entire line.
+    // For monospace fonts, most characters have the same width, so the line is split into segments: runs of
+    // single-byte characters with the monospace advance, and single characters with other widths (e.g. tabs and wide
+    // characters). Positions in runs are calculated, so pure ASCII lines only need a single segment.
+    struct LineMetrics {
+        struct Segment {
+            std::size_t byte; // Byte offset where the segment starts
+            float x; // x-position where the segment starts
+            bool isRun; // If this is a run of characters with the monospace advance
+        };
+
+        std::pmr::vector<float> widths; // Byte positions for proportional fonts
+        std::pmr::vector<Segment> segments; // Segments for monospace fonts, followed by the end of the line
+        float advance = 0.0f; // Monospace advance, 0 for proportional fonts
+
+        // Metrics are allocator-aware, so metrics in the width cache use the cache's memory resource
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        LineMetrics() = default;
+
+        explicit LineMetrics(const allocator_type& allocator) : widths{ allocator }, segments{ allocator } {}
+
+        // Measures a line with the current font.
+        // If asciiRuns is set, all printable ASCII characters are assumed to have the monospace advance.
+        // ASCII lines are measured without decoding characters.
+        void build(std::string_view line, float monospaceAdvance, bool asciiRuns, Encoding encoding);
+
+        // Gets the x-position where a character (given by its byte offset) starts.
+        float getPosX(std::size_t byteIdx) const;
+
+        // Gets the byte offset of the character at an x-position, the result is within [rowStart, rowEnd].
+        std::size_t getCharAt(std::string_view line, float posX, std::size_t rowStart, std::size_t rowEnd) const;
+    };
+
+    // Cache of line metrics, used to avoid re-measuring text when hit-testing and drawing
+    bool widthCacheEnabled = false;
+    mutable std::pmr::unordered_map<std::size_t, LineMetrics> widthCache{ memoryResource };
+
+    // Shared cache of line metrics, used instead of the width cache if set
+    // Lines are looked up by the hash of their content, which is kept for each line (keyed by absolute line number like
+    // the width cache) so lines aren't hashed again on every lookup.
+    MetricsCache* metricsCache = nullptr;
+    mutable std::pmr::unordered_map<std::size_t, std::size_t> lineHashes{ memoryResource };
+
+    // Metrics of the last measured line when the cache is disabled, only used for monospace fonts
+    // These are only kept for the current frame.
+    mutable LineMetrics scratchMetrics{ memoryResource };
+    mutable std::size_t scratchLineIdx = std::string_view::npos;
+
+    // Measured horizontal extent of the selection on a line
+    // Spans are kept between frames and reused as long as the line's text and the selected range on it are unchanged,
+    // so only lines whose selection edges moved are measured again. Positions are relative to the start of the text so
+    // scrolling does not invalidate them.
+    struct SelectionSpan {
+        const char* lineData; // Text of the line when it was measured
+        std::size_t lineSize;
+        std::size_t startX; // Selected byte range on the line
+        std::size_t endX; // npos if the selection continues to the next line
+        float minX; // Display extent of the selected range
+        float maxX;
+    };
+
+    // Spans of the lines drawn in the last frame, the buffer is storage for building the next frame's spans
+    mutable std::pmr::vector<SelectionSpan> selectionSpans{ memoryResource };
+    mutable std::pmr::vector<SelectionSpan> selectionSpansBuffer{ memoryResource };
+    mutable std::size_t selectionSpansFirst = 0; // Line number of the first span
+
+    // Rectangle of the selection highlight, in screen coordinates
+    struct SelectionRect {
+        ImVec2 min;
+        ImVec2 max;
+        bool isFullLine; // If the rectangle covers a whole line (or wrapped row), i.e. it is in the selection's middle
+    };
+
+    // Rectangles collected while drawing the selection, they are written to the draw list in one batch
+    mutable std::pmr::vector<SelectionRect> selectionRects{ memoryResource };
+
+    // If consecutive full-line rectangles are merged into one
+    bool mergeMiddleLines = false;
+
+    // Storage for hit-testing: the line and index of each query sorted by line, and the results
+    mutable std::pmr::vector<std::array<std::size_t, 2>> hitTestOrder{ memoryResource };
+    mutable std::pmr::vector<CursorPos> hitTestResults{ memoryResource };
+
+    // Wrap width for lines, wrapping is disabled if this is not positive
+    float wrapWidth = 0.0f;
+
+    // Width of the widest line drawn by render(), used as the width of the content so it can be scrolled horizontally
+    mutable float textWidth = 0.0f;
+
+    // Line geometry index, only used when wrapping is enabled
+    // Wrapped lines take up a variable amount of vertical space, so this contains the y-position of the top of each
+    // line relative to the start of the text. The last element is the bottom of the last indexed line. The index is
+    // built lazily, only as far as the lines that have been needed so far.
+    // Positions are stored as doubles to avoid precision loss in large documents. When lines are removed from the
+    // front, their entries are removed and the remaining positions are offset by the new first line's position.
+    mutable std::pmr::deque<double> lineOffsetsY{ { 0.0 }, memoryResource };
+    double lineOffsetsBaseY = 0.0;
+
+    // Total number of lines removed from the front of the text source
+    // Per-line caches are keyed by absolute line numbers (line number + removed lines), so removing lines doesn't
+    // invalidate them.
+    std::size_t removedLines = 0;
+
+    Config config;
+
+    // Values of the configuration resolved for the current frame
+    struct FrameMetrics {
+        float newlineWidth = 0.0f;
+        float rowHeight = 0.0f; // Height of a line of text (a row of a wrapped line)
+        float lineHeight = 0.0f; // Height of an unwrapped line including spacing
+        ImU32 selectionColor = 0;
+        ImU32 highlightColor = 0;
+        ImU32 textColor = 0;
+    };
+
+    FrameMetrics frameMetrics;
+
+    // Metrics the cached measurements were made with, all caches are cleared when these change
+    const ImFont* cacheFont = nullptr;
+    float cacheFontSize = 0.0f;
+    FrameMetrics cacheMetrics;
+
+    // Monospace fast path mode, and the width of characters in the current font if it is treated as monospace (0
+    // otherwise)
+    MonospaceMode monospaceMode = MonospaceMode::Auto;
+    float monospaceAdvance = 0.0f;
+    bool monospaceAsciiRuns = false; // If all printable ASCII characters have the monospace advance
+
+    // Encoding of the text source
+    Encoding encoding = Encoding::UTF8;
+
+    // Mouse position relative to the start of the text when the selection was last updated by dragging
+    ImVec2 lastMousePos{ -1.0f, -1.0f };
+
+    // Scrolling while dragging outside of the window
+    AutoscrollPolicy autoscrollPolicy;
+    float autoscrollTime = 0.0f; // Time in seconds the mouse cursor has been outside of the window
+    float autoscrollPages = 0.0f; // Fraction of a page accumulated for the next page jump
+
+    // X-position kept while moving the end of the selection up and down with the keyboard, negative if not set
+    // Moving through shorter lines does not change the position, so rows below a long line are entered at the same
+    // column.
+    float keyboardPosX = -1.0f;
+
+#ifdef TEXTSELECT_STATS
+    mutable Stats stats;
+#endif
+
+    // Pending request to select a match, resolved in update() once enough lines have been searched
+    enum class FindRequest { None, Next, Previous };
+
+    // Find state
+    // Lines are searched incrementally in update(), at most findLineBudget lines per frame, starting from the first
+    // line. Matches are kept until the pattern changes or the text is reported as changed with clearCaches().
+    std::string findPattern;
+    std::pmr::vector<FindMatch> findMatches{ memoryResource }; // Non-overlapping matches, sorted by position
+    std::size_t findScannedLines = 0; // Lines [0, findScannedLines) have been searched
+    std::size_t findLineBudget = 10000;
+    bool findComplete = true; // If all lines have been searched
+    FindRequest findRequest = FindRequest::None;
+    bool highlightMatches = false;
+
+    // Gets the metrics of a line, measuring it if needed.
+    // Returns nullptr if the line should be measured with Dear ImGui instead (proportional fonts without the cache).
+    const LineMetrics* getLineMetrics(std::size_t lineIdx, std::string_view line) const;
+
+    // Gets the x-position where a character (given by its byte offset) in a line starts.
+    // The position is relative to the start of the wrapped row starting at rowStart.
+    float getCharPosX(std::size_t lineIdx, std::string_view line, std::size_t byteIdx, std::size_t rowStart = 0) const;
+
+    // Gets the byte offset of the character at an x-position in a line.
+    // The position is relative to the start of the wrapped row [rowStart, rowEnd), and the result is within the row.
+    // The line's metrics are looked up if they are not given.
+    std::size_t getCharIndexAt(std::size_t lineIdx, std::string_view line, float posX, std::size_t rowStart = 0,
+        std::size_t rowEnd = std::string_view::npos, const LineMetrics* metrics = nullptr) const;
+
+    // Gets the y-position of the top of a line relative to the start of the text.
+    float getLineY(std::size_t lineIdx) const;
+
+    // Gets the number of the line at a y-position relative to the start of the text (capped to the last line).
+    std::size_t getLineAtY(float posY, std::size_t numLines) const;
+
+    // Extends the line geometry index so it contains at least the given number of lines.
+    void extendLineOffsets(std::size_t count) const;
+
+    // Gets the cursor position (line number and byte offset) at a point relative to the start of the text.
+    CursorPos getCursorPosAt(const ImVec2& pos, std::size_t numLines) const;
+
+    // Gets the cursor position at a point relative to the start of the text, given the line containing the point.
+    CursorPos getCursorPosInLine(const ImVec2& pos, std::size_t lineIdx, std::string_view line,
+        const LineMetrics* metrics) const;
+
+    // Gets the point relative to the start of the text where a cursor position is displayed.
+    // The y-position is the vertical center of the (wrapped) row containing the position.
+    ImVec2 getCursorPoint(const CursorPos& pos) const;
+
+    // Scrolls the window so the text between two cursor positions is visible.
+    // If center is set, the text is centered in the window, otherwise the window is scrolled as little as possible.
+    void scrollIntoView(const ImVec2& cursorPosStart, const CursorPos& start, const CursorPos& end, bool center) const;
+
+    // Gets the height of all lines, as laid out by render().
+    // With wrapping, lines that have not been indexed yet are estimated to have a single row.
+    float getContentHeight(std::size_t numLines) const;
+
+    // Gets the first and last (inclusive) line numbers which intersect the current window's clip rect.
+    std::array<std::size_t, 2> getVisibleLines(const ImVec2& cursorPosStart, std::size_t numLines) const;
+
+    // State of a background copy
+    // The worker thread reads the text through its own copy of the line source, and the finished text is put on the
+    // clipboard by update() on the main thread.
+    struct AsyncCopy {
+        std::atomic<std::size_t> linesDone = 0; // Lines are counted once when measuring and once when copying
+        std::size_t totalLines = 0;
+        std::atomic<bool> done = false;
+        std::unique_ptr<char[]> text; // Null-terminated text, only accessed by the main thread once done is set
+        std::vector<std::string_view> lines; // Selected lines of vector sources, which can be reallocated meanwhile
+        std::jthread thread; // Declared last so it is joined before the other members are destroyed
+    };
+
+    std::unique_ptr<AsyncCopy> asyncCopy; // Background copy in progress, if any
+    bool asyncCopyEnabled = false; // If the copy shortcut copies in the background
+
+    // Calls a function with each piece of a selection's text in a line source, in order (see forEachSelectedChunk).
+    // onFetch is called with the number of lines before each range of lines is fetched, and can return false to stop.
+    // Returns if all pieces were visited.
+    template <class F, class G>
+    static bool forEachChunk(const LineSource& source, const Selection& selection, F&& callback, G&& onFetch);
+
+    // Collects the selected text on the worker thread of a background copy.
+    static void runAsyncCopy(std::stop_token stopToken, AsyncCopy& state, LineSource source, Selection selection);
+
+    // State of a background precomputation of the line geometry index
+    // Worker threads claim chunks of lines in order and count their wrapped rows, each reading the text through its
+    // own copy of the line source. Finished chunks are added to the index by the main thread.
+    struct GeometryJob {
+        std::size_t firstLine = 0; // Line where the index ended when the job started
+        std::size_t numLines = 0;
+        std::size_t sourceFirstLine = 0; // Number of the first line in the workers' line source
+        std::vector<std::string_view> lines; // Lines of vector sources, which can be reallocated meanwhile
+        std::vector<std::vector<std::uint32_t>> chunkRows; // Number of rows of each line, by chunk
+        std::unique_ptr<std::atomic<bool>[]> chunkDone; // If the rows of each chunk can be read by the main thread
+        std::atomic<std::size_t> nextChunk = 0; // Next chunk to be claimed by a worker
+        std::atomic<std::size_t> indexedLines = 0; // Lines of the job in the index, chunks before this are skipped
+        std::vector<std::jthread> threads; // Declared last so they are joined before the other members are destroyed
+    };
+
+    mutable std::unique_ptr<GeometryJob> geometryJob; // Background precomputation in progress, if any
+    std::size_t precomputeThreads = 0; // Number of worker threads for precomputation, 0 if disabled
+
+    // Counts the rows of the lines in chunks of a geometry job on a worker thread.
+    static void runGeometryJob(std::stop_token stopToken, GeometryJob& job, LineSource source, ImFont* font,
+        float scale, float wrapWidth);
+
+    // Starts precomputing the geometry of the lines after the end of the index if there are enough of them.
+    void startPrecompute(std::size_t numLines);
+
+    // Adds the lines of finished chunks at the end of the index to it. Returns if any lines were added.
+    bool mergePrecomputedLines() const;
+
+    // Resolves the configuration for the current frame.
+    void resolveConfig();
+
+    // Clears cached measurements if the current font or line height changed since they were made.
+    void validateCaches();
+
+    // Gets the class of a character with the configured classifier.
+    CharClass classifyChar(char32_t c) const;
+
+    // Clears cached line measurements (everything cleared by clearCaches() except find results).
+    void clearMeasurements() {
+        textWidth = 0.0f;
+        widthCache.clear();
+        scratchLineIdx = std::string_view::npos;
+        selectionSpans.clear();
+        lineOffsetsY = { 0.0 };
+        lineOffsetsBaseY = 0.0;
+        geometryJob.reset();
+    }
+
+    // Discards find matches and searches the text for the current pattern again from the first line.
+    void restartFind();
+
+    // Sets the find pattern, restarting the search if it changed.
+    void setFindPattern(std::string_view pattern);
+
+    // Searches the next lines for the find pattern, up to the per-frame line budget.
+    void continueFind(std::size_t numLines);
+
+    // Selects the match requested by findNext() once it is known and scrolls it into view.
+    void resolveFindRequest(const ImVec2& cursorPosStart);
+
+    // Rebuilds the sorted index of anchors if they changed.
+    void buildAnchorIndex() const;
+
+    // Gets the byte range of a line that is inside the columns of the block selection.
+    std::array<std::size_t, 2> getBlockColumns(std::size_t lineIdx, std::string_view line) const;
+
+    // Calls a function with the selected columns of each line in the block selection, with newlines between lines.
+    template <class F>
+    void forEachBlockChunk(F&& callback) const;
+
+    // Calls a function with each piece of the selected text, in order (see forEachSelectedChunk).
+    // The function is called directly instead of through std::function, so capturing lambdas don't allocate.
+    template <class F>
+    void walkSelectedChunks(F&& callback) const;
 
     // Processes mouse down (click/drag) events.
-    void handleMouseDown(const ImVec2& cursorPosStart);
+    void handleMouseDown(const ImVec2& cursorPosStart, std::size_t numLines);
+
+    // Processes keyboard events for extending the selection.
+    void handleKeyboard(const ImVec2& cursorPosStart, std::size_t numLines);
 
     // Processes scrolling events.
-    void handleScrolling() const;
+    void handleScrolling();
+
+    // Adds a rectangle to the batch of selection rectangles.
+    // Rectangles that continue the previous one vertically with the same horizontal extent are merged into it.
+    void addSelectionRect(const ImVec2& min, const ImVec2& max, bool isFullLine) const;
+
+    // Writes the batch of selection rectangles to the window's draw list with a single reservation.
+    void emitSelectionRects(ImU32 color) const;
+
+    // Adds the rectangles for the selected range [startX, endX) of a line, wrapped or not.
+    // endX is npos if the selection continues to the next line.
+    void addLineSelectionRects(const ImVec2& cursorPosStart, std::size_t lineIdx, std::string_view line,
+        std::size_t startX, std::size_t endX) const;
+
+    // Draws the rectangles of highlights in the window.
+    void drawHighlights(const ImVec2& cursorPosStart, std::size_t numLines) const;
+
+    // Draws the highlight rectangles of find matches in the window.
+    void drawMatches(const ImVec2& cursorPosStart, std::size_t numLines) const;
+
+    // Adds the text selection rectangles for the selected range [startX, endX) of a wrapped line.
+    // endX is npos if the selection continues to the next line.
+    void drawWrappedSelection(const ImVec2& cursorPosStart, std::size_t lineIdx, std::string_view line,
+        std::size_t startX, std::size_t endX) const;
 
     // Draws the text selection rectangle in the window.
-    void drawSelection(const ImVec2& cursorPosStart) const;
+    void drawSelection(const ImVec2& cursorPosStart, std::size_t numLines) const;
+
+    // Draws the visible lines of text and reserves the space of all lines in the window.
+    void drawText(const ImVec2& cursorPosStart, std::size_t numLines) const;
+
+    // Runs the per-frame work of update() and render().
+    void updateFrame(bool renderText);
 
 public:
+    // Cache of line measurements that can be shared by multiple TextSelect instances.
+    // Lines are identified by the font they are measured with and a hash of their text, so instances showing the same
+    // text share measurements. The least recently used lines are dropped when the cache grows past its size limit.
+    // The cache must outlive the instances using it, and it can only be used from one thread. If fonts are rebuilt,
+    // call clear() since fonts are identified by address.
+    class MetricsCache {
+    public:
+        // Creates a cache that holds at most about maxBytes bytes of measurements.
+        explicit MetricsCache(std::size_t maxBytes = 16 * 1024 * 1024) : maxBytes(maxBytes) {}
+
+        // Removes all measurements.
+        void clear() {
+            entries.clear();
+            index.clear();
+            usedBytes = 0;
+        }
+
+        // Gets the approximate number of bytes used by the measurements.
+        std::size_t size() const {
+            return usedBytes;
+        }
+
+    private:
+        friend class TextSelect;
+
+        // Identity of a measured line
+        struct Key {
+            const ImFont* font;
+            float fontSize;
+            float monospaceAdvance; // Lines are measured differently depending on the monospace fast path
+            std::size_t hash; // Hash of the line's text
+            std::size_t size; // Size of the line's text in bytes, reduces the chance of hash collisions affecting lines
+
+            bool operator==(const Key&) const = default;
+        };
+
+        struct KeyHash {
+            std::size_t operator()(const Key& key) const;
+        };
+
+        struct Entry {
+            Key key;
+            LineMetrics metrics;
+            std::size_t bytes;
+        };
+
+        std::size_t maxBytes;
+        std::size_t usedBytes = 0;
+        std::list<Entry> entries; // Ordered from most to least recently used
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+
+        // Gets the metrics of a line, measuring it if it is not in the cache.
+        // The result is valid until the next call.
+        const LineMetrics& get(const Key& key, std::string_view line, bool asciiRuns, Encoding encoding);
+    };
+
+    // All constructors take an optional memory resource, which is used for the caches and scratch buffers reused across
+    // frames (width cache, selection geometry, line geometry index, lines fetched from accessor functions, find
+    // matches, anchors, highlights, and text collected by copy()). With a pooling resource, measuring, drawing, and
+    // copying don't use the global allocator once the pool has grown. The resource must outlive this object, and it is
+    // only used from the thread calling update() (background copies and precomputation use the global allocator, and
+    // a shared MetricsCache has its own storage).
+
     // Sets the text accessor functions.
     // getLineAtIdx: Function taking a std::size_t (line number) and returning the string in that line
     // getNumLines: Function returning a std::size_t (total number of lines of text)
+    // The functions are stored in std::function objects, which may allocate for large function objects.
     template <class T, class U>
-    TextSelect(const T& getLineAtIdx, const U& getNumLines) : getLineAtIdx(getLineAtIdx), getNumLines(getNumLines) {}
+    requires std::is_invocable_r_v<std::string_view, const T&, std::size_t>
+        && std::is_invocable_r_v<std::size_t, const U&>
+    TextSelect(const T& getLineAtIdx, const U& getNumLines,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : memoryResource{ resource } {
+        lineSource.getLineAtIdx = getLineAtIdx;
+        lineSource.getNumLines = getNumLines;
+    }
+
+    // Sets the text accessor functions as function pointers, which are called with a user data pointer.
+    // This doesn't allocate or go through std::function.
+    TextSelect(std::string_view (*getLineAtIdx)(std::size_t idx, void* userData),
+        std::size_t (*getNumLines)(void* userData), void* userData,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : memoryResource{ resource } {
+        lineSource.getLineAtIdxPtr = getLineAtIdx;
+        lineSource.getNumLinesPtr = getNumLines;
+        lineSource.userData = userData;
+    }
+
+    // Sets a vector of lines as the text source.
+    // The vector is not copied, it must outlive this object. Lines may be added or removed between frames.
+    TextSelect(const std::vector<std::string_view>& lines,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : memoryResource{ resource } {
+        lineSource.vector = &lines;
+    }
+
+    // Temporary vectors cannot be used as a text source.
+    TextSelect(std::vector<std::string_view>&&, std::pmr::memory_resource* = nullptr) = delete;
+
+    // Sets a TextSelectSource object as the text source.
+    // The source is not copied, it must outlive this object.
+    template <TextSelectSource T>
+    TextSelect(T& source, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : memoryResource{ resource } {
+        lineSource.object = &source;
+        lineSource.objectLines = [](void* object, std::size_t first, std::size_t count) {
+            return std::span<const std::string_view>{ static_cast<T*>(object)->lines(first, count) };
+        };
+        lineSource.objectNumLines = [](void* object) {
+            return static_cast<std::size_t>(static_cast<T*>(object)->numLines());
+        };
+
+        if constexpr (requires { T::encoding; }) encoding = T::encoding;
+    }
+
+    // Gets the default class of a character for word selection.
+    // This is a constant time lookup in a table covering Latin, Cyrillic, and other alphabetic scripts, punctuation
+    // and symbols, CJK, and whitespace.
+    static CharClass getCharClass(char32_t c);
+
+    // Converts a byte offset in a line to a character (codepoint) index.
+    // Positions in lines are stored as byte offsets, this can be used to get character positions for display.
+    static std::size_t byteToCharIndex(std::string_view line, std::size_t byteIdx);
+
+    // Converts a character (codepoint) index in a line to a byte offset, or the size of the line if out of range.
+    static std::size_t charToByteIndex(std::string_view line, std::size_t charIdx);
 
     // Checks if there is an active selection in the text.
     bool hasSelection() const {
         return !selectStart.isInvalid() && !selectEnd.isInvalid();
     }
 
+    // Gets the selection, with start and end in order. All positions are std::string_view::npos if there is none.
+    // Block selections are given as the selection between their first and last positions.
+    Selection getSelection() const;
+
+    // Sets the selection. Start and end can be in any order.
+    void setSelection(const Selection& selection);
+
+    // Clears the selection.
+    void clearSelection();
+
+    // Adds an anchor, or replaces the anchor with the same name. Start and end can be in any order.
+    // Anchors are kept on the same text when lines are removed from the front, and removed along with their text.
+    void setAnchor(std::string_view name, const Selection& selection);
+
+    // Removes an anchor if it exists.
+    void removeAnchor(std::string_view name);
+
+    // Removes all anchors.
+    void clearAnchors();
+
+    // Gets an anchor by name, or nullptr if it does not exist.
+    const Selection* getAnchor(std::string_view name) const;
+
+    // Calls a function with each anchor intersecting a range of lines (inclusive), in order of their start positions.
+    // Anchors are indexed by position, so this takes logarithmic time in the number of anchors for each anchor found.
+    void forEachAnchorInLines(std::size_t firstLine, std::size_t lastLine,
+        const std::function<void(const Anchor&)>& callback) const;
+
+    // Calls a function with each anchor intersecting the lines in the window's visible area.
+    // This must be called in the window after update() or render().
+    void forEachVisibleAnchor(const std::function<void(const Anchor&)>& callback) const;
+
+    // Adds a highlight. Start and end can be in any order.
+    // Highlights are drawn under find matches and the selection in update() and render(). They are indexed by
+    // position, so only the highlights in the visible lines are processed in a frame. Overlapping highlights are drawn
+    // in order of their start positions (later ones on top), highlights at the same position in the order they were
+    // added.
+    void addHighlight(const Selection& selection, ImU32 color = 0);
+
+    // Replaces all highlights.
+    void setHighlights(std::span<const Highlight> newHighlights);
+
+    // Removes all highlights.
+    void clearHighlights();
+
+    // Gets the cursor positions (line numbers and byte offsets) of the characters at points in screen coordinates.
+    // Each point is handled like a click at that point, so points outside of the text are moved to the nearest line.
+    // The points are sorted by line, and each line is fetched and measured once for all points on it. The results are
+    // in the order of the points, and valid until the next call. This must be called in the window after update() or
+    // render().
+    std::span<const CursorPos> hitTest(std::span<const ImVec2> points) const;
+
+    // Gets the screen rectangle (min and max) of the character at a cursor position.
+    // Positions at the end of a line get a rectangle with no width. This must be called in the window after update() or
+    // render().
+    std::array<ImVec2, 2> getCharRect(const CursorPos& pos) const;
+
+    // Checks if the selection is a block (column) selection, made by dragging with Alt held.
+    // Block selections are not available when lines are wrapped.
+    bool isBlockSelection() const {
+        return blockSelection;
+    }
+
+    // Calls a function with each piece of the selected text, in order.
+    // Pieces point directly into the text source. Newlines added between lines that don't already end with one are
+    // passed as separate pieces.
+    void forEachSelectedChunk(const std::function<void(std::string_view)>& callback) const;
+
+    // Gets the size of the selected text in bytes, including added newlines.
+    std::size_t getSelectedTextSize() const;
+
+    // Copies the selected text into a buffer. No null terminator is written.
+    // The text is truncated if the buffer is too small. Returns the number of bytes written.
+    std::size_t copyTo(std::span<char> buffer) const;
+
     // Copies the selected text to the clipboard.
     void copy() const;
 
+    // Copies the selected text to the clipboard in the background, cancelling any background copy in progress.
+    // Block selections are copied immediately since their columns are measured with the current font. The text is
+    // collected on a worker thread and put on the clipboard by update() once it is ready. The text source
+    // is read from the worker thread, so it must be safe to use from another thread, and the text of the selected
+    // lines must not change until the copy finishes or is cancelled (appending lines is fine). For vector sources, the
+    // selected line views are copied when the copy starts, so the vector itself can be changed by the main thread.
+    void copyAsync();
+
+    // Checks if a background copy is in progress.
+    bool isCopying() const {
+        return asyncCopy != nullptr;
+    }
+
+    // Gets the progress of the background copy in progress, from 0 to 1.
+    float getCopyProgress() const;
+
+    // Cancels the background copy in progress, waiting for the worker thread to stop.
+    void cancelCopy() {
+        asyncCopy.reset();
+    }
+
+    // Sets if the copy keyboard shortcut uses copyAsync() instead of copy() (off by default).
+    // Enabling this declares that the text source is safe to read from another thread.
+    void setAsyncCopyEnabled(bool enabled);
+
+    // Sets the number of worker threads which precompute the positions of wrapped lines (0 to disable, the default).
+    // Finding a wrapped line's position requires counting the rows of all lines before it. For large texts, workers
+    // count the rows of the remaining lines in the background when the text is shown, or when the font or wrap width
+    // changes, and update() adds them to the line geometry index as they finish. Lines needed before then (e.g. the
+    // visible lines) are measured on the main thread as usual. The text source is read from the worker threads, so it
+    // must be safe to use from other threads (vector sources are safe, the workers read copies of their line views so
+    // lines can be appended meanwhile). Rows are counted with the font's glyph advance tables, so the font atlas must
+    // not be rebuilt while precomputation is in progress (see cancelPrecompute()).
+    void setPrecomputeThreads(std::size_t threads);
+
+    // Checks if wrapped lines are being precomputed in the background.
+    bool isPrecomputing() const {
+        return geometryJob != nullptr;
+    }
+
+    // Gets the progress of the precomputation in progress, from 0 to 1.
+    float getPrecomputeProgress() const;
+
+    // Cancels the precomputation in progress, waiting for the worker threads to stop.
+    // It is restarted by the next call to update() if lines are still left to be measured.
+    void cancelPrecompute() {
+        geometryJob.reset();
+    }
+
     // Selects all text in the window.
     void selectAll();
 
+    // Enables or disables caching of line display widths.
+    // This makes hit-testing and selection drawing on long lines much faster at the cost of extra memory per cached
+    // line. The cache is cleared automatically when the font or font size changes.
+    void setWidthCacheEnabled(bool enabled);
+
+    // Sets a shared cache of line measurements, instead of this object's own width cache (nullptr to stop using it).
+    // The cache must outlive this object.
+    void setMetricsCache(MetricsCache* cache);
+
+    // Sets how the monospace fast path is used (Auto by default).
+    void setMonospaceMode(MonospaceMode mode);
+
+    // Sets the encoding of the text (UTF-8 by default, or the encoding declared by a TextSelectSource).
+    // Text declared as ASCII must not contain bytes of 0x80 or above.
+    void setEncoding(Encoding newEncoding);
+
+    // Sets the width at which lines are wrapped. Wrapping is disabled if the width is not positive (the default).
+    // The text must be displayed with the same wrap width, e.g. with ImGui::PushTextWrapPos() or ImGui::TextWrapped(),
+    // which wrap at ImGui::GetContentRegionAvail().x. Lines should not contain newlines except at their ends.
+    void setWrapWidth(float width);
+
+    // Sets the configuration.
+    void setConfig(const Config& newConfig);
+
+    // Gets the configuration.
+    const Config& getConfig() const {
+        return config;
+    }
+
+    // Sets how the window is scrolled while a selection is dragged outside of it.
+    void setAutoscrollPolicy(const AutoscrollPolicy& policy);
+
+    // Sets if the rectangles of lines in the middle of a selection are merged into a single rectangle (off by default).
+    // This keeps the number of vertices per frame constant for large selections, but the merged rectangle is as wide
+    // as the longest line, so the highlight no longer follows the ends of shorter lines.
+    void setMergeMiddleLines(bool enabled);
+
+    // Clears all cached line measurements (line widths, selection rectangles, and wrapped line positions) and restarts
+    // the current search. This must be called if the contents of any lines change while the width cache, wrapping, or
+    // find is in use.
+    void clearCaches() {
+        clearMeasurements();
+        lineHashes.clear();
+        restartFind();
+    }
+
+    // Starts searching the text for a pattern (case-sensitive), and returns the matches found so far.
+    // The search continues in the following calls to update(), see isFindComplete(). Calling this again with the same
+    // pattern does not restart the search, so it can be called every frame.
+    std::span<const FindMatch> findAll(std::string_view pattern);
+
+    // Selects the next (or previous) match of a pattern after (or before) the current selection, wrapping around at
+    // the end of the text, and scrolls it into view.
+    // The match is selected in update() once the lines containing it have been searched, which may take multiple
+    // frames for large texts.
+    void findNext(std::string_view pattern, bool backwards = false);
+
+    // Checks if the search for the current find pattern has gone through all lines.
+    bool isFindComplete() const {
+        return findComplete;
+    }
+
+    // Stops searching and clears the find matches.
+    void clearFind() {
+        setFindPattern({});
+    }
+
+    // Sets if all find matches are highlighted (off by default).
+    void setHighlightMatches(bool enabled);
+
+    // Sets the maximum number of lines searched per frame (10000 by default).
+    void setFindLineBudget(std::size_t lines);
+
+    // Notifies this object that lines were added to the end of the text source.
+    // Appended lines don't invalidate any cached state (the line geometry index is extended as lines are needed, and
+    // an ongoing search continues into the new lines), so sources that only grow don't need to call this.
+    void notifyLinesAppended([[maybe_unused]] std::size_t count) {}
+
+    // Notifies this object that lines were removed from the start of the text source, e.g. when a log buffer is full.
+    // The selection is moved so it stays on the same text, and cached state of the remaining lines is kept. A
+    // background copy in progress is cancelled.
+    void notifyLinesRemovedFront(std::size_t count);
+
+#ifdef TEXTSELECT_STATS
+    // Gets the statistics of the last frame.
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    // Shows a window with the statistics of the last frame.
+    void showStatsWindow(const char* title = "TextSelect Stats", bool* open = nullptr) const;
+#endif
+
     // Draws the text selection rectangle and handles user input.
     void update();
+
+    // Draws the text and the text selection rectangle, and handles user input.
+    // This replaces drawing the text separately and calling update(). Only the visible lines are drawn, using the same
+    // line positions as selection and hit-testing (including wrapping), and the space of all lines is reserved with a
+    // single item so the window can be scrolled. This must be called before other items in the window.
+    void render();
 };
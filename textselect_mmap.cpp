@@ -0,0 +1,176 @@
+// Copyright 2024-2025 Aidan Sun and the ImGuiTextSelect contributors
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "textselect_mmap.hpp"
+
+// Number of bytes scanned for newlines before the lines found in them are made available.
+static constexpr std::size_t indexBlockSize = 1 << 20;
+
+// Finds the next newline in a range of bytes, or returns nullptr if there is none.
+// memchr is vectorized by the standard library, so this checks many bytes at a time.
+static const char* findNewline(const char* begin, const char* end) {
+    return static_cast<const char*>(std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+}
+
+MappedFileSource::MappedFileSource(const std::filesystem::path& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        unmap();
+        return;
+    }
+
+    // Empty files can't be mapped, they are opened with no lines
+    size = static_cast<std::size_t>(fileSize.QuadPart);
+    if (size > 0) {
+        mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle) data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+        if (!data) {
+            unmap();
+            return;
+        }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    // Empty files can't be mapped, they are opened with no lines
+    // The mapping stays valid after the file is closed.
+    struct stat fileStat {};
+    bool mapped = fstat(fd, &fileStat) == 0;
+    if (mapped && fileStat.st_size > 0) {
+        size = static_cast<std::size_t>(fileStat.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) mapped = false;
+        else data = static_cast<const char*>(mapping);
+    }
+
+    ::close(fd);
+    if (!mapped) {
+        size = 0;
+        return;
+    }
+#endif
+
+    opened = true;
+    lineStarts.push_back(0);
+    indexThread = std::jthread{ [this](std::stop_token stopToken) { buildIndex(stopToken); } };
+}
+
+MappedFileSource::~MappedFileSource() {
+    // The indexing thread reads the mapping, so it has to stop first
+    if (indexThread.joinable()) {
+        indexThread.request_stop();
+        indexThread.join();
+    }
+
+    unmap();
+}
+
+void MappedFileSource::unmap() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (data) munmap(const_cast<char*>(data), size);
+#endif
+
+    data = nullptr;
+    size = 0;
+}
+
+void MappedFileSource::buildIndex(std::stop_token stopToken) {
+    std::size_t lineCount = 0;
+    std::vector<std::size_t> newLineStarts;
+
+    for (std::size_t blockStart = 0; blockStart < size; blockStart += indexBlockSize) {
+        if (stopToken.stop_requested()) return;
+
+        // Each newline starts a new line, the starts of every indexStride-th line are stored
+        const char* blockEnd = data + std::min(size, blockStart + indexBlockSize);
+        for (const char* p = data + blockStart; (p = findNewline(p, blockEnd)); p++) {
+            lineCount++;
+            if (lineCount % indexStride == 0) newLineStarts.push_back(static_cast<std::size_t>(p + 1 - data));
+        }
+
+        // Make the lines in this block available, the stored line starts must be added before the lines
+        {
+            std::scoped_lock lock{ indexMutex };
+            lineStarts.insert(lineStarts.end(), newLineStarts.begin(), newLineStarts.end());
+        }
+        newLineStarts.clear();
+
+        indexedBytes.store(static_cast<std::size_t>(blockEnd - data), std::memory_order_relaxed);
+        indexedLines.store(lineCount, std::memory_order_release);
+    }
+
+    // The last line doesn't need to end with a newline
+    if (size > 0 && data[size - 1] != '\n') indexedLines.store(lineCount + 1, std::memory_order_release);
+    indexComplete.store(true, std::memory_order_release);
+}
+
+std::size_t MappedFileSource::nextLineStart(std::size_t offset) const {
+    const char* newline = findNewline(data + offset, data + size);
+    return newline ? static_cast<std::size_t>(newline + 1 - data) : size;
+}
+
+std::span<const std::string_view> MappedFileSource::lines(std::size_t first, std::size_t count) const {
+    // Each thread has its own buffer, so lines can be read from multiple threads at once
+    thread_local std::vector<std::string_view> buffer;
+    buffer.clear();
+    if (count == 0) return buffer;
+
+    // Start from the nearest stored line start, then scan to the first line
+    std::size_t offset = 0;
+    {
+        std::scoped_lock lock{ indexMutex };
+        offset = lineStarts[first / indexStride];
+    }
+
+    for (std::size_t i = first % indexStride; i > 0; i--) offset = nextLineStart(offset);
+
+    for (std::size_t i = 0; i < count; i++) {
+        // Line endings are not included in lines
+        std::size_t next = nextLineStart(offset);
+        std::size_t end = next > offset && data[next - 1] == '\n' ? next - 1 : next;
+        if (end > offset && data[end - 1] == '\r') end--;
+
+        buffer.emplace_back(data + offset, end - offset);
+        offset = next;
+    }
+
+    return buffer;
+}
@@ -0,0 +1,97 @@
+// Copyright 2024-2025 Aidan Sun and the ImGuiTextSelect contributors
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Text source for TextSelect which reads lines from a memory-mapped file.
+// The file is never loaded into memory as a whole, lines are views into the mapping. The newline index is built on a
+// background thread, lines become available as they are indexed (like lines appended to a log), so large files can be
+// displayed right away. Only the start of every indexStride-th line is stored, other lines are found by scanning from
+// the nearest stored line, so the index takes a small fraction of the file's size.
+// Lines do not include their line endings ("\n" or "\r\n"). The file must not be modified while it is mapped.
+class MappedFileSource {
+    // A line start is stored in the index for each of this many lines
+    static constexpr std::size_t indexStride = 64;
+
+    // Contents of the file
+    bool opened = false;
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+    // Byte offsets of the start of every indexStride-th line, starting with line 0
+    mutable std::mutex indexMutex;
+    std::vector<std::size_t> lineStarts;
+
+    // Progress of the indexing thread, lines up to indexedLines can be read
+    std::atomic<std::size_t> indexedLines = 0;
+    std::atomic<std::size_t> indexedBytes = 0;
+    std::atomic<bool> indexComplete = false;
+
+    // Thread building the index
+    std::jthread indexThread;
+
+    // Scans the file for newlines and adds them to the index.
+    void buildIndex(std::stop_token stopToken);
+
+    // Gets the offset of the start of the line after the line starting at an offset.
+    std::size_t nextLineStart(std::size_t offset) const;
+
+    // Unmaps the file and closes it.
+    void unmap();
+
+public:
+    // Opens and maps a file, then starts indexing it in the background. Use isOpen() to check if this succeeded.
+    explicit MappedFileSource(const std::filesystem::path& path);
+
+    // Stops indexing and unmaps the file.
+    ~MappedFileSource();
+
+    // Sources own the mapping and the indexing thread, so they cannot be copied.
+    MappedFileSource(const MappedFileSource&) = delete;
+    MappedFileSource& operator=(const MappedFileSource&) = delete;
+
+    // Checks if the file was opened and mapped.
+    bool isOpen() const {
+        return opened;
+    }
+
+    // Gets the contents of the file.
+    std::string_view text() const {
+        return { data, size };
+    }
+
+    // Checks if all lines of the file have been indexed.
+    bool isIndexComplete() const {
+        return indexComplete.load(std::memory_order_acquire);
+    }
+
+    // Gets the progress of indexing, from 0 to 1.
+    float getIndexProgress() const {
+        return size == 0 ? 1.0f : static_cast<float>(indexedBytes.load()) / static_cast<float>(size);
+    }
+
+    // Gets the number of lines that have been indexed so far.
+    std::size_t numLines() const {
+        return indexedLines.load(std::memory_order_acquire);
+    }
+
+    // Gets a range of lines that have been indexed.
+    // This can be called from multiple threads (e.g. by TextSelect::copyAsync()). The span is valid until the next call
+    // to lines() of any MappedFileSource from the same thread.
+    std::span<const std::string_view> lines(std::size_t first, std::size_t count) const;
+};
@@ -7,3 +7,11 @@ target("example")
     add_packages("imgui", "glfw", "opengl", "utfcpp")
     add_files("example/main.cpp", "textselect.cpp")
     add_includedirs(".")
+
+target("bench")
+    set_languages("c++20")
+    set_optimize("fastest")
+
+    add_packages("imgui", "utfcpp")
+    add_files("bench/main.cpp", "textselect.cpp", "textselect_mmap.cpp")
+    add_includedirs(".")